@@ -26,6 +26,8 @@
 #include "bluetoothdownloadjob.h"
 #include "core_debug.h"
 
+#include <QPointer>
+
 BluetoothDeviceLink::BluetoothDeviceLink(const QString& deviceId, LinkProvider* parent, QBluetoothSocket* socket)
     : DeviceLink(deviceId, parent)
     , mSocketReader(new DeviceLineReader(socket, this))
@@ -41,6 +43,7 @@ BluetoothDeviceLink::BluetoothDeviceLink(const QString& deviceId, LinkProvider*
     //destroyed as well
     mBluetoothSocket->setParent(this);
     connect(mBluetoothSocket, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+    connect(mBluetoothSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(transportWritten(qint64)));
 }
 
 QString BluetoothDeviceLink::name()
@@ -53,10 +56,25 @@ bool BluetoothDeviceLink::sendPacket(NetworkPacket& np)
     if (np.hasPayload()) {
         BluetoothUploadJob* uploadJob = new BluetoothUploadJob(np.payload(), mBluetoothSocket->peerAddress(), this);
         np.setPayloadTransferInfo(uploadJob->transferInfo());
+        QPointer<QIODevice> payload = np.payload().data();
+        connect(uploadJob, &BluetoothUploadJob::peerConnected, this, [this, payload]() {
+            if (payload) {
+                Q_EMIT payloadStarted(payload.data());
+            }
+        });
         uploadJob->start();
     }
-    int written = mSocketReader->write(np.serialize());
-    return (written != -1);
+    return enqueuePacket(np, np.serialize(wireFormat()));
+}
+
+qint64 BluetoothDeviceLink::transportBytesToWrite() const
+{
+    return mBluetoothSocket->bytesToWrite();
+}
+
+qint64 BluetoothDeviceLink::writeToTransport(const char* data, qint64 size)
+{
+    return mBluetoothSocket->write(data, size);
 }
 
 void BluetoothDeviceLink::userRequestsPair() {
@@ -73,31 +91,39 @@ bool BluetoothDeviceLink::linkShouldBeKeptAlive() {
 
 void BluetoothDeviceLink::dataReceived()
 {
-    if (mSocketReader->bytesAvailable() == 0) return;
-
-    const QByteArray serializedPacket = mSocketReader->readLine();
-
-    //qCDebug(KDECONNECT_CORE) << "BluetoothDeviceLink dataReceived" << packet;
-
-    NetworkPacket packet(QString::null);
-    NetworkPacket::unserialize(serializedPacket, &packet);
-
-    if (packet.type() == PACKET_TYPE_PAIR) {
-        //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
-        mPairingHandler->packetReceived(packet);
-        return;
+    //Handle every packet the reader has and give them to the device in a single batch
+    QVector<NetworkPacket> packets;
+    packets.reserve(int(mSocketReader->bytesAvailable()));
+    while (mSocketReader->bytesAvailable() > 0) {
+        const QByteArray serializedPacket = mSocketReader->readLine();
+
+        //qCDebug(KDECONNECT_CORE) << "BluetoothDeviceLink dataReceived" << packet;
+
+        NetworkPacket packet(QString::null);
+        NetworkPacket::unserialize(serializedPacket, &packet, NetworkPacket::LazyBody);
+
+        if (packet.type() == PACKET_TYPE_PAIR) {
+            //Whatever came before must be handled before the pairing status changes
+            if (!packets.isEmpty()) {
+                Q_EMIT receivedPackets(packets);
+                packets.clear();
+            }
+            //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
+            mPairingHandler->packetReceived(packet);
+            continue;
+        }
+
+        if (packet.hasPayloadTransferInfo()) {
+            BluetoothDownloadJob* downloadJob = new BluetoothDownloadJob(mBluetoothSocket->peerAddress(),
+                                                                         packet.payloadTransferInfo(), this);
+            downloadJob->start();
+            packet.setPayload(downloadJob->payload(), packet.payloadSize());
+        }
+
+        packets.append(packet);
     }
 
-    if (packet.hasPayloadTransferInfo()) {
-        BluetoothDownloadJob* downloadJob = new BluetoothDownloadJob(mBluetoothSocket->peerAddress(),
-                                                                     packet.payloadTransferInfo(), this);
-        downloadJob->start();
-        packet.setPayload(downloadJob->payload(), packet.payloadSize());
-    }
-
-    Q_EMIT receivedPacket(packet);
-
-    if (mSocketReader->bytesAvailable() > 0) {
-        QMetaObject::invokeMethod(this, "dataReceived", Qt::QueuedConnection);
+    if (!packets.isEmpty()) {
+        Q_EMIT receivedPackets(packets);
     }
 }
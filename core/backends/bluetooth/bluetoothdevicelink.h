@@ -45,6 +45,10 @@ public:
 
     virtual bool linkShouldBeKeptAlive() override;
 
+protected:
+    qint64 transportBytesToWrite() const override;
+    qint64 writeToTransport(const char* data, qint64 size) override;
+
 private Q_SLOTS:
     void dataReceived();
 
@@ -191,7 +191,7 @@ void BluetoothLinkProvider::clientIdentityReceived()
     BluetoothDeviceLink* deviceLink = new BluetoothDeviceLink(deviceId, this, socket);
 
     NetworkPacket np2("");
-    NetworkPacket::createIdentityPacket(&np2);
+    NetworkPacket::createIdentityPacket(&np2, linkCapabilities());
     success = deviceLink->sendPacket(np2);
 
     if (success) {
@@ -201,6 +201,9 @@ void BluetoothLinkProvider::clientIdentityReceived()
         connect(deviceLink, SIGNAL(destroyed(QObject*)),
                 this, SLOT(deviceLinkDestroyed(QObject*)));
 
+        //Only now, our own identity packet had to be sent as JSON
+        deviceLink->setPeerIdentity(receivedPacket);
+
         Q_EMIT onConnectionReceived(receivedPacket, deviceLink);
 
         //We kill any possible link from this same device
@@ -233,7 +236,7 @@ void BluetoothLinkProvider::serverNewConnection()
     connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
 
     NetworkPacket np2("");
-    NetworkPacket::createIdentityPacket(&np2);
+    NetworkPacket::createIdentityPacket(&np2, linkCapabilities());
     socket->write(np2.serialize());
 
     qCDebug(KDECONNECT_CORE()) << "Sent identity packet to" << socket->peerAddress();
@@ -274,6 +277,8 @@ void BluetoothLinkProvider::serverDataReceived()
     connect(deviceLink, SIGNAL(destroyed(QObject*)),
             this, SLOT(deviceLinkDestroyed(QObject*)));
 
+    deviceLink->setPeerIdentity(receivedPacket);
+
     Q_EMIT onConnectionReceived(receivedPacket, deviceLink);
 
     addLink(deviceLink, deviceId);
@@ -69,6 +69,7 @@ void BluetoothUploadJob::newConnection()
             deleteLater();
             return;
         }
+        Q_EMIT peerConnected();
     }
 
     connect(m_socket, &QBluetoothSocket::bytesWritten, this, &BluetoothUploadJob::writeSome);
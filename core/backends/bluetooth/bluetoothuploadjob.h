@@ -40,6 +40,9 @@ public:
     QVariantMap transferInfo() const;
     void start();
 
+Q_SIGNALS:
+    void peerConnected();
+
 private:
     QSharedPointer<QIODevice> mData;
     QBluetoothAddress mRemoteAddress;
@@ -21,6 +21,8 @@
 
 #include "devicelinereader.h"
 
+#include "core/networkpacket.h"
+
 DeviceLineReader::DeviceLineReader(QIODevice* device, QObject* parent)
     : QObject(parent)
     , m_device(device)
@@ -33,10 +35,23 @@ DeviceLineReader::DeviceLineReader(QIODevice* device, QObject* parent)
 
 void DeviceLineReader::dataReceived()
 {
-    while(m_device->canReadLine()) {
-        const QByteArray line = m_device->readLine();
-        if (line.length() > 1) {
-            m_packets.enqueue(line);//we don't want single \n
+    char header[NetworkPacket::s_frameHeaderSize];
+    qint64 peeked;
+    while ((peeked = m_device->peek(header, sizeof(header))) > 0) {
+        if (NetworkPacket::isFrameMarker(header[0])) {
+            const qint64 frameSize = NetworkPacket::binaryFrameSize(header, peeked);
+            if (frameSize < 0 || m_device->bytesAvailable() < frameSize) {
+                break;
+            }
+            m_packets.enqueue(m_device->read(frameSize));
+        } else {
+            if (!m_device->canReadLine()) {
+                break;
+            }
+            const QByteArray line = m_device->readLine();
+            if (line.length() > 1) {
+                m_packets.enqueue(line);//we don't want single \n
+            }
         }
     }
 
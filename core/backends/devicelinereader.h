@@ -29,7 +29,7 @@
 /*
  * Encapsulates a QIODevice and implements the same methods of its API that are
  * used by LanDeviceLink and BluetoothDeviceLink, but readyRead is emitted only
- * when a newline is found.
+ * when a newline (or a whole binary frame) is found.
  */
 class DeviceLineReader
     : public QObject
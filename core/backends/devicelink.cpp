@@ -19,8 +19,17 @@
  */
 
 #include "devicelink.h"
+#include "core_debug.h"
 #include "kdeconnectconfig.h"
 #include "linkprovider.h"
+#include "pluginloader.h"
+
+const qint64 DeviceLink::s_highWatermark;
+const qint64 DeviceLink::s_lowWatermark;
+const qint64 DeviceLink::s_bulkWatermark;
+const qint64 DeviceLink::s_bulkSliceSize;
+const qint64 DeviceLink::s_maxQueuedBytes;
+const int DeviceLink::s_throughputWindow;
 
 DeviceLink::DeviceLink(const QString& deviceId, LinkProvider* parent)
     : QObject(parent)
@@ -28,12 +37,204 @@ DeviceLink::DeviceLink(const QString& deviceId, LinkProvider* parent)
     , m_deviceId(deviceId)
     , m_linkProvider(parent)
     , m_pairStatus(NotPaired)
+    , m_bulkOffset(0)
+    , m_transportFull(false)
+    , m_queuedBytes(0)
+    , m_busyBytes(0)
+    , m_throughput(-1)
+    , m_errorRate(0)
 {
     Q_ASSERT(!deviceId.isEmpty());
 
     setProperty("deviceId", deviceId);
 }
 
+void DeviceLink::setPeerIdentity(const NetworkPacket& identityPacket)
+{
+    const QSet<QString> capabilities = identityPacket.get<QStringList>(QStringLiteral("linkCapabilities")).toSet()
+                                     & m_linkProvider->linkCapabilities().toSet();
+    if (capabilities != m_linkCapabilities) {
+        m_linkCapabilities = capabilities;
+        Q_EMIT linkCapabilitiesChanged();
+    }
+}
+
+NetworkPacket::WireFormat DeviceLink::wireFormat() const
+{
+    return hasLinkCapability(LINK_CAPABILITY_CBOR)? NetworkPacket::CborFormat : NetworkPacket::JsonFormat;
+}
+
+bool DeviceLink::enqueuePacket(const NetworkPacket& np, const QByteArray& data)
+{
+    const bool bulk = PluginLoader::instance()->isBulkPacketType(np.type());
+    QQueue<QueuedPacket>& queue = bulk? m_bulkQueue : m_interactiveQueue;
+
+    //If this packet makes an older queued one useless, take its place
+    const QString key = supersedeKey(np);
+    if (!key.isEmpty()) {
+        for (int i = (bulk && m_bulkOffset > 0)? 1 : 0; i < queue.size(); ++i) {
+            QueuedPacket& queued = queue[i];
+            if (queued.supersedeKey == key) {
+                const qint64 delta = data.size() - queued.data.size();
+                if (m_queuedBytes + delta > s_maxQueuedBytes) {
+                    qCWarning(KDECONNECT_CORE) << "Send queue for" << deviceId() << "is full, dropping packet" << np.type();
+                    sendResult(false);
+                    return false;
+                }
+                m_queuedBytes += delta;
+                queued.data = data;
+                sendQueuedPackets();
+                return true;
+            }
+        }
+    }
+
+    if (m_queuedBytes + data.size() > s_maxQueuedBytes) {
+        qCWarning(KDECONNECT_CORE) << "Send queue for" << deviceId() << "is full, dropping packet" << np.type();
+        sendResult(false);
+        return false;
+    }
+
+    queue.enqueue({np.type(), key, data, false});
+    m_queuedBytes += data.size();
+    sendQueuedPackets();
+    return true;
+}
+
+bool DeviceLink::enqueueFrame(const QByteArray& data, bool bulk)
+{
+    if (m_queuedBytes + data.size() > s_maxQueuedBytes) {
+        qCWarning(KDECONNECT_CORE) << "Send queue for" << deviceId() << "is full, dropping frame";
+        return false;
+    }
+
+    (bulk? m_bulkQueue : m_interactiveQueue).enqueue({QStringLiteral("frame"), QString(), data, true});
+    m_queuedBytes += data.size();
+    sendQueuedPackets();
+    return true;
+}
+
+qint64 DeviceLink::interactiveBacklog() const
+{
+    qint64 backlog = transportBytesToWrite();
+    for (const QueuedPacket& packet : m_interactiveQueue) {
+        backlog += packet.data.size();
+    }
+    if (m_bulkOffset > 0) {
+        backlog += m_bulkQueue.head().data.size() - m_bulkOffset;
+    }
+    return backlog;
+}
+
+QString DeviceLink::supersedeKey(const NetworkPacket& np)
+{
+    //Packets carrying a payload are never replaced, the peer would miss the transfer
+    if (np.hasPayload() || !PluginLoader::instance()->isSupersedable(np.type())) {
+        return QString();
+    }
+
+    //A packet only replaces another one with the same fields for the same player, so eg: a
+    //status update doesn't replace a player list, nor one player's status another's.
+    QStringList keys = np.body().keys();
+    keys.prepend(np.get<QString>(QStringLiteral("player")));
+    keys.prepend(np.type());
+    return keys.join(QLatin1Char('\n'));
+}
+
+void DeviceLink::sendQueuedPackets()
+{
+    //Packets are lines (or frames) on the wire, so a bulk packet we started writing must be
+    //finished before anything else goes out. Writing it in slices keeps what is left of it short.
+    while (true) {
+        const qint64 pending = transportBytesToWrite();
+        if (m_bulkOffset == 0 && !m_interactiveQueue.isEmpty()) {
+            if (pending >= s_highWatermark || (m_transportFull && pending > s_lowWatermark)) {
+                m_transportFull = true;
+                return;
+            }
+            m_transportFull = false;
+            const QueuedPacket packet = m_interactiveQueue.dequeue();
+            m_queuedBytes -= packet.data.size();
+            writeQueuedPacket(packet);
+        } else if (!m_bulkQueue.isEmpty()) {
+            if (pending >= s_bulkWatermark) {
+                return;
+            }
+            const QueuedPacket& packet = m_bulkQueue.head();
+            const qint64 slice = qMin(s_bulkSliceSize, packet.data.size() - m_bulkOffset);
+            const bool written = writeToTransport(packet.data.constData() + m_bulkOffset, slice) == slice;
+            if (!written) {
+                qCWarning(KDECONNECT_CORE) << "Could not send queued packet" << packet.type << "to" << deviceId();
+                m_bulkOffset = packet.data.size();
+            } else {
+                m_bulkOffset += slice;
+            }
+            if (m_bulkOffset == packet.data.size()) {
+                if (!packet.frame) {
+                    sendResult(written);
+                }
+                m_queuedBytes -= packet.data.size();
+                m_bulkQueue.dequeue();
+                m_bulkOffset = 0;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+void DeviceLink::transportReplaced()
+{
+    if (m_bulkOffset > 0) {
+        qCDebug(KDECONNECT_CORE) << "Sending" << m_bulkQueue.head().type << "to" << deviceId() << "again through the new connection";
+        m_bulkOffset = 0;
+    }
+    m_transportFull = false;
+}
+
+bool DeviceLink::writeQueuedPacket(const QueuedPacket& packet)
+{
+    const bool written = writeToTransport(packet.data.constData(), packet.data.size()) == packet.data.size();
+    if (!written) {
+        qCWarning(KDECONNECT_CORE) << "Could not send queued packet" << packet.type << "to" << deviceId();
+    }
+    if (!packet.frame) {
+        sendResult(written);
+    }
+    return written;
+}
+
+void DeviceLink::transportWritten(qint64 bytes)
+{
+    //When nothing waits to be written we only see how much there was to send, not how fast it goes
+    if (m_busySince.isValid()) {
+        m_busyBytes += bytes;
+        const qint64 elapsed = m_busySince.elapsed();
+        if (elapsed >= s_throughputWindow) {
+            const double sample = m_busyBytes * 1000.0 / elapsed;
+            m_throughput = m_throughput < 0? sample : 0.75 * m_throughput + 0.25 * sample;
+            m_busyBytes = 0;
+            m_busySince.start();
+        }
+    }
+
+    sendQueuedPackets();
+
+    if (m_queuedBytes == 0 && transportBytesToWrite() == 0) {
+        m_busySince.invalidate();
+    } else if (!m_busySince.isValid()) {
+        m_busyBytes = 0;
+        m_busySince.start();
+    }
+}
+
+void DeviceLink::sendResult(bool sent)
+{
+    //Once per packet: when it was written to the transport, or when we gave up on it.
+    //Roughly the last ten packets
+    m_errorRate = 0.9 * m_errorRate + (sent? 0 : 0.1);
+}
+
 void DeviceLink::setPairStatus(DeviceLink::PairStatus status)
 {
     if (m_pairStatus != status) {
@@ -22,16 +22,21 @@
 #define DEVICELINK_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QQueue>
+#include <QVector>
 #include <QtCrypto>
 
 #include "core/networkpacket.h"
+#include "kdeconnectcore_export.h"
 
 class PairingHandler;
 class NetworkPacket;
 class LinkProvider;
 class Device;
 
-class DeviceLink
+class KDECONNECTCORE_EXPORT DeviceLink
     : public QObject
 {
     Q_OBJECT
@@ -49,6 +54,43 @@ public:
 
     virtual bool sendPacket(NetworkPacket& np) = 0;
 
+    //Link level features supported by both ends, taken from the identity packet of the peer
+    void setPeerIdentity(const NetworkPacket& identityPacket);
+    bool hasLinkCapability(const QString& capability) const { return m_linkCapabilities.contains(capability); }
+    NetworkPacket::WireFormat wireFormat() const;
+
+    //Packets accepted by sendPacket that are still waiting to be handed to the transport
+    int queuedPackets() const { return m_interactiveQueue.size() + m_bulkQueue.size(); }
+    qint64 queuedBytes() const { return m_queuedBytes; }
+    //Bytes an interactive packet queued now would have to wait for: what the transport didn't write yet,
+    //the interactive queue and the rest of a bulk packet being written
+    qint64 interactiveBacklog() const;
+    //The link refuses packets until some of the queued ones are written
+    bool isQueueFull() const { return m_queuedBytes >= s_maxQueuedBytes; }
+
+    //In milliseconds, for links that measure them. -1 if unknown.
+    virtual double roundTripTime() const { return -1; }
+    virtual double roundTripJitter() const { return -1; }
+    //Bytes per second the transport writes while it has a backlog, -1 until measured
+    double throughput() const { return m_throughput; }
+    //Bytes per second of the payloads, for links that send them apart from the packets. -1 if unknown.
+    virtual double payloadThroughput() const { return -1; }
+    //Recent share of packets the link failed to send, from 0 to 1
+    double errorRate() const { return m_errorRate; }
+
+    //Interactive packets are written while the transport has less than s_highWatermark bytes pending.
+    //Once it's full we wait until it's down to s_lowWatermark, so a slow peer doesn't wake us up to
+    //write a packet every time it takes a few bytes. Bulk packets (as marked by the plugins that send them) only while it has less than
+    //s_bulkWatermark, s_bulkSliceSize bytes at a time, so they never pile up in front of interactive ones.
+    const static qint64 s_highWatermark = 256 * 1024;
+    const static qint64 s_lowWatermark = 64 * 1024;
+    const static qint64 s_bulkWatermark = 32 * 1024;
+    const static qint64 s_bulkSliceSize = 16 * 1024;
+    //Packets are refused once the queues hold this much
+    const static qint64 s_maxQueuedBytes = 8 * 1024 * 1024;
+    //Throughput is sampled over periods of at least this many milliseconds
+    const static int s_throughputWindow = 500;
+
     //user actions
     virtual void userRequestsPair() = 0;
     virtual void userRequestsUnpair() = 0;
@@ -65,15 +107,61 @@ Q_SIGNALS:
     void pairStatusChanged(DeviceLink::PairStatus status);
     void pairingError(const QString& error);
     void receivedPacket(const NetworkPacket& np);
+    //Several packets that arrived together, in the order they were received
+    void receivedPackets(const QVector<NetworkPacket>& packets);
+    //The peer identity changed what the link supports
+    void linkCapabilitiesChanged();
+    //The peer started receiving the payload of a packet we sent (see TransferScheduler)
+    void payloadStarted(QIODevice* payload);
+
+protected Q_SLOTS:
+    //Writes as much of the queues as the transport accepts, links call it when the transport has written data
+    void sendQueuedPackets();
+    //Same, for links to tell how much the transport wrote so the throughput can be measured
+    void transportWritten(qint64 bytes);
 
 protected:
+    //Queues an already serialized packet for the transport, returns false if the queues are full
+    bool enqueuePacket(const NetworkPacket& np, const QByteArray& data);
+    //Queues data that is not a packet (eg: frames of payload streams) behind what is queued with the same priority
+    bool enqueueFrame(const QByteArray& data, bool bulk);
+
+    //For links that replaced their transport: a packet that was only partly written to the
+    //old one is sent again from its beginning, the rest of it would break the framing
+    void transportReplaced();
+
+    //The transport used by the queues
+    virtual qint64 transportBytesToWrite() const { return 0; }
+    virtual qint64 writeToTransport(const char* data, qint64 size) { Q_UNUSED(data); return size; }
+
     QCA::PrivateKey m_privateKey;
 
 private:
+    struct QueuedPacket {
+        QString type;
+        QString supersedeKey; //Empty if this packet must not be replaced by newer ones
+        QByteArray data;
+        bool frame; //Not a packet, it doesn't count for the error rate
+    };
+    static QString supersedeKey(const NetworkPacket& np);
+    bool writeQueuedPacket(const QueuedPacket& packet);
+    void sendResult(bool sent);
+
     const QString m_deviceId;
     LinkProvider* m_linkProvider;
     PairStatus m_pairStatus;
-
+    QSet<QString> m_linkCapabilities;
+
+    QQueue<QueuedPacket> m_interactiveQueue;
+    QQueue<QueuedPacket> m_bulkQueue; //The head is being written if m_bulkOffset > 0
+    qint64 m_bulkOffset;
+    bool m_transportFull; //Waiting for it to go down to s_lowWatermark
+    qint64 m_queuedBytes;
+
+    QElapsedTimer m_busySince; //Invalid while there is nothing waiting to be written
+    qint64 m_busyBytes;
+    double m_throughput;
+    double m_errorRate;
 };
 
 #endif
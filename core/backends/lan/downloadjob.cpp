@@ -27,23 +27,22 @@
 #include <netdb.h>
 #endif
 
+#include <QTimer>
+#include <QtEndian>
+
 #include "kdeconnectconfig.h"
+#include "networkpacket.h"
 #include "lanlinkprovider.h"
 #include "core/core_debug.h"
 
+const int DownloadPayload::s_maxResumeAttempts;
+
 DownloadJob::DownloadJob(const QHostAddress& address, const QVariantMap& transferInfo)
     : KJob()
-    , m_address(address)
-    , m_port(transferInfo[QStringLiteral("port")].toInt())
-    , m_socket(new QSslSocket)
+    , m_payload(new DownloadPayload(address, transferInfo))
 {
-    LanLinkProvider::configureSslSocket(m_socket.data(), transferInfo.value(QStringLiteral("deviceId")).toString(), true);
-
-    connect(m_socket.data(), SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketFailed(QAbstractSocket::SocketError)));
-    connect(m_socket.data(), &QAbstractSocket::connected, this, &DownloadJob::socketConnected);
-    // emit readChannelFinished when the socket gets disconnected. This seems to be a bug in upstream QSslSocket.
-    // Needs investigation and upstreaming of the fix. QTBUG-62257
-    connect(m_socket.data(), &QAbstractSocket::disconnected, m_socket.data(), &QAbstractSocket::readChannelFinished);
+    connect(m_payload.data(), &DownloadPayload::connected, this, &DownloadJob::socketConnected);
+    connect(m_payload.data(), &DownloadPayload::connectionFailed, this, &DownloadJob::socketFailed);
 }
 
 DownloadJob::~DownloadJob()
@@ -54,24 +53,244 @@ DownloadJob::~DownloadJob()
 void DownloadJob::start()
 {
     //TODO: Timeout?
-    // Cannot use read only, might be due to ssl handshake, getting QIODevice::ReadOnly error and no connection
-    m_socket->connectToHostEncrypted(m_address.toString(), m_port, QIODevice::ReadWrite);
+    m_payload->start();
 }
 
-void DownloadJob::socketFailed(QAbstractSocket::SocketError error)
+void DownloadJob::socketFailed(QAbstractSocket::SocketError error, const QString& errorString)
 {
-    qWarning() << error << m_socket->errorString();
+    qWarning() << error << errorString;
     setError(error + 1);
-    setErrorText(m_socket->errorString());
+    setErrorText(errorString);
     emitResult();
 }
 
 QSharedPointer<QIODevice> DownloadJob::getPayload()
 {
-    return m_socket.staticCast<QIODevice>();
+    return m_payload.staticCast<QIODevice>();
 }
 
 void DownloadJob::socketConnected()
 {
     emitResult();
 }
+
+DownloadPayload::DownloadPayload(const QHostAddress& address, const QVariantMap& transferInfo)
+    : m_address(address)
+    , m_port(quint16(transferInfo.value(QStringLiteral("port")).toUInt()))
+    , m_token(transferInfo.value(QStringLiteral("token")).toString().toLatin1())
+    , m_deviceId(transferInfo.value(QStringLiteral("deviceId")).toString())
+    , m_size(transferInfo.value(QStringLiteral("size"), -1).toLongLong())
+    , m_socket(nullptr)
+    , m_received(0)
+    , m_attempts(0)
+    , m_everConnected(false)
+    , m_finished(false)
+    , m_verify(transferInfo.value(QStringLiteral("checksum")).toString() == QLatin1String("xxh64") && m_size > 0)
+    , m_verified(false)
+{
+    open(QIODevice::ReadOnly);
+}
+
+void DownloadPayload::start()
+{
+    if (!m_socket && !m_finished) {
+        connectToPeer();
+    }
+}
+
+void DownloadPayload::connectToPeer()
+{
+    m_socket = new QSslSocket(this);
+    LanLinkProvider::configureSslSocket(m_socket, m_deviceId, true);
+
+    connect(m_socket, &QAbstractSocket::connected, this, &DownloadPayload::socketConnected);
+    connect(m_socket, &QSslSocket::encrypted, this, [this]() { m_attempts = 0; });
+    connect(m_socket, &QIODevice::readyRead, this, &QIODevice::readyRead);
+    // We don't rely on the socket emitting readChannelFinished when it gets disconnected. This seems to be
+    // a bug in upstream QSslSocket. Needs investigation and upstreaming of the fix. QTBUG-62257
+    connect(m_socket, &QAbstractSocket::disconnected, this, &DownloadPayload::socketClosed);
+    connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketClosed()));
+
+    // Cannot use read only, might be due to ssl handshake, getting QIODevice::ReadOnly error and no connection
+    if (m_token.isEmpty()) {
+        m_socket->connectToHostEncrypted(m_address.toString(), m_port, QIODevice::ReadWrite);
+    } else {
+        m_socket->connectToHost(m_address, m_port, QIODevice::ReadWrite);
+    }
+}
+
+bool DownloadPayload::resumeFrom(qint64 offset, const QByteArray& prefixTail)
+{
+    if (m_token.isEmpty() || m_everConnected || m_received > 0 || offset <= 0 || offset >= m_size) {
+        return false;
+    }
+    m_received = offset;
+    m_tail = prefixTail.right(int(NetworkPacket::s_resumeCheckSize));
+    //We don't have the beginning to check the payload against its checksum
+    m_verify = false;
+    return true;
+}
+
+void DownloadPayload::socketConnected()
+{
+    if (!m_token.isEmpty()) {
+        //The uploader finds its payload from the token and then starts encrypting, as the TLS client
+        QByteArray request = m_token;
+        //Every new connection is a resume, even with nothing received, so the uploader knows not to send the checksum
+        if (m_received > 0 || m_everConnected) {
+            request += ' ' + QByteArray::number(m_received) + ' ' + NetworkPacket::payloadResumeChecksum(m_tail).toHex();
+        }
+        m_socket->write(request + '\n');
+        m_socket->startServerEncryption();
+    }
+
+    if (!m_everConnected) {
+        m_everConnected = true;
+        Q_EMIT connected();
+    }
+}
+
+void DownloadPayload::socketClosed()
+{
+    if (sender() == m_socket) {
+        checkSocket();
+    }
+}
+
+void DownloadPayload::checkSocket()
+{
+    //Errors come before disconnected, and what is left in the socket can still be read
+    if (m_finished || m_socket->state() != QAbstractSocket::UnconnectedState || readable() > 0) {
+        return;
+    }
+
+    if (isComplete()) {
+        finish();
+        return;
+    }
+
+    if (!m_everConnected) {
+        Q_EMIT connectionFailed(m_socket->error(), m_socket->errorString());
+    }
+    if (m_token.isEmpty() || m_size < 0 || !m_everConnected) {
+        finish(m_size < 0? QString() : m_socket->errorString());
+        return;
+    }
+    if (m_attempts >= s_maxResumeAttempts) {
+        finish(QStringLiteral("Couldn't resume the transfer: %1").arg(m_socket->errorString()));
+        return;
+    }
+
+    qCDebug(KDECONNECT_CORE) << "Payload connection lost after" << m_received << "of" << m_size << "bytes, resuming";
+    //Right away the first time, the network may need a while to come back after that
+    QTimer::singleShot(m_attempts == 0? 0 : s_resumeRetryInterval, this, &DownloadPayload::reconnect);
+    m_attempts++;
+}
+
+void DownloadPayload::reconnect()
+{
+    if (m_finished) {
+        return;
+    }
+    m_socket->disconnect(this);
+    m_socket->deleteLater();
+    //The uploader would have to read everything it sent again to give us the checksum of the whole payload
+    m_verify = false;
+    connectToPeer();
+}
+
+bool DownloadPayload::isComplete() const
+{
+    return m_size >= 0 && m_received >= m_size && (!m_verify || m_verified);
+}
+
+qint64 DownloadPayload::readable() const
+{
+    if (!m_socket) {
+        return 0;
+    }
+    const qint64 available = m_socket->bytesAvailable();
+    if (!m_verify) {
+        return available;
+    }
+
+    //The last byte waits for the checksum, so the reader never sees the whole payload if it's wrong
+    const qint64 remaining = m_size - m_received;
+    if (remaining == 0) {
+        return 0;
+    }
+    if (available >= remaining + PayloadChecksum::s_trailerSize) {
+        return remaining;
+    }
+    return qMin(available, remaining - 1);
+}
+
+void DownloadPayload::close()
+{
+    //The reader doesn't want the rest
+    m_finished = true;
+    if (m_socket) {
+        m_socket->disconnect(this);
+        m_socket->abort();
+    }
+    QIODevice::close();
+}
+
+qint64 DownloadPayload::bytesAvailable() const
+{
+    return readable() + QIODevice::bytesAvailable();
+}
+
+qint64 DownloadPayload::readData(char* data, qint64 maxSize)
+{
+    const qint64 size = m_socket? m_socket->read(data, qMin(maxSize, readable())) : 0;
+    if (size > 0) {
+        if (m_verify) {
+            m_checksum.addData(data, size);
+        }
+        m_received += size;
+        if (!m_token.isEmpty()) {
+            m_tail.append(data, int(size));
+            if (m_tail.size() > 2 * NetworkPacket::s_resumeCheckSize) {
+                m_tail.remove(0, m_tail.size() - int(NetworkPacket::s_resumeCheckSize));
+            }
+        }
+    }
+
+    if (m_verify && !m_verified && m_received == m_size) {
+        uchar trailer[PayloadChecksum::s_trailerSize];
+        m_socket->read(reinterpret_cast<char*>(trailer), sizeof(trailer));
+        if (qFromBigEndian<quint64>(trailer) != m_checksum.result()) {
+            finish(QStringLiteral("The payload doesn't match its checksum"));
+            return -1;
+        }
+        m_verified = true;
+    }
+
+    //A closed socket is only dealt with once we read everything it had
+    if (!m_finished && m_socket && m_socket->state() == QAbstractSocket::UnconnectedState && readable() == 0) {
+        QMetaObject::invokeMethod(this, "checkSocket", Qt::QueuedConnection);
+    }
+
+    if (size <= 0) {
+        return m_finished? -1 : 0;
+    }
+    return size;
+}
+
+qint64 DownloadPayload::writeData(const char* data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+void DownloadPayload::finish(const QString& error)
+{
+    m_finished = true;
+    if (!error.isEmpty()) {
+        qCWarning(KDECONNECT_CORE) << "Download failed:" << error;
+        setErrorString(error);
+    }
+    Q_EMIT readChannelFinished();
+}
@@ -28,11 +28,14 @@
 #include <QHostAddress>
 #include <QSharedPointer>
 #include <QSslSocket>
-#include <QBuffer>
 
 #include "kdeconnectcore_export.h"
+#include "core/transferscheduler.h"
+#include "payloadchecksum.h"
 
 
+class DownloadPayload;
+
 class KDECONNECTCORE_EXPORT DownloadJob
     : public KJob
 {
@@ -44,13 +47,82 @@ public:
     QSharedPointer<QIODevice> getPayload();
 
 private:
-    QHostAddress m_address;
-    qint16 m_port;
-    QSharedPointer<QSslSocket> m_socket;
+    QSharedPointer<DownloadPayload> m_payload;
 
 private Q_SLOTS:
-    void socketFailed(QAbstractSocket::SocketError error);
+    void socketFailed(QAbstractSocket::SocketError error, const QString& errorString);
     void socketConnected();
 };
 
+/*
+ * The data of a download, read from its connection.
+ *
+ * Payloads sent with a token (see UploadJob::setTransferToken) survive losing the connection:
+ * we connect again and send the token followed by how much we have and the checksum of it
+ * (see NetworkPacket::payloadResumeChecksum), so the sender continues from there. The transfer
+ * info has to include the size of the payload for that.
+ *
+ * If the sender ends the payload with its checksum, we check it as the data goes through, and
+ * fail instead of giving the reader its last byte if it doesn't match. Resumed payloads don't
+ * have it.
+ */
+class KDECONNECTCORE_EXPORT DownloadPayload
+    : public ScheduledPayload
+{
+    Q_OBJECT
+
+public:
+    DownloadPayload(const QHostAddress& address, const QVariantMap& transferInfo);
+
+    //Connects to the sender, only the first time it's called
+    void start() override;
+
+    //Must be called before we are connected, only payloads sent with a token can resume
+    bool resumeFrom(qint64 offset, const QByteArray& prefixTail) override;
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+    bool atEnd() const override { return m_finished && bytesAvailable() == 0; }
+    void close() override;
+
+    const static int s_maxResumeAttempts = 10;
+    const static int s_resumeRetryInterval = 2000;
+
+Q_SIGNALS:
+    void connected();
+    void connectionFailed(QAbstractSocket::SocketError error, const QString& errorString);
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private Q_SLOTS:
+    void socketConnected();
+    void socketClosed();
+    void checkSocket();
+    void reconnect();
+
+private:
+    void connectToPeer();
+    bool isComplete() const;
+    qint64 readable() const;
+    void finish(const QString& error = QString());
+
+    const QHostAddress m_address;
+    const quint16 m_port;
+    const QByteArray m_token; //Sent to uploaders listening for many payloads on the same port
+    const QString m_deviceId;
+    const qint64 m_size;
+
+    QSslSocket* m_socket;
+    qint64 m_received; //Including what we had before resuming
+    QByteArray m_tail; //The last bytes we received, to prove what we have when resuming
+    int m_attempts;
+    bool m_everConnected;
+    bool m_finished;
+    bool m_verify; //The payload ends with its checksum (see PayloadChecksum)
+    bool m_verified;
+    PayloadChecksum m_checksum;
+};
+
 #endif // UPLOADJOB_H
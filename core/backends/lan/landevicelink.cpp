@@ -28,25 +28,46 @@
 #include "downloadjob.h"
 #include "socketlinereader.h"
 #include "lanlinkprovider.h"
+#include "payloadstreams.h"
+#include "rangeddownload.h"
+#include "linkheartbeat.h"
+
+#include <QFile>
+#include <QPointer>
 
 LanDeviceLink::LanDeviceLink(const QString& deviceId, LinkProvider* parent, QSslSocket* socket, ConnectionStarted connectionSource)
     : DeviceLink(deviceId, parent)
     , m_socketLineReader(nullptr)
+    , m_payloadStreams(new PayloadStreams(this))
+    , m_heartbeat(new LinkHeartbeat(this))
+    , m_payloadThroughput(-1)
 {
+    connect(m_payloadStreams, &PayloadStreams::frameReady, this, &LanDeviceLink::sendStreamFrame);
+    connect(m_heartbeat, &LinkHeartbeat::frameReady, this, &LanDeviceLink::sendHeartbeatFrame);
+    connect(m_heartbeat, &LinkHeartbeat::linkDead, this, &LanDeviceLink::heartbeatTimedOut);
     reset(socket, connectionSource);
 }
 
 void LanDeviceLink::reset(QSslSocket* socket, ConnectionStarted connectionSource)
 {
+    const bool replacesConnection = m_socketLineReader != nullptr;
     if (m_socketLineReader) {
         disconnect(m_socketLineReader->m_socket, &QAbstractSocket::disconnected, this, &QObject::deleteLater);
         delete m_socketLineReader;
     }
 
     m_socketLineReader = new SocketLineReader(socket, this);
+    m_lastReceived.invalidate();
+    if (replacesConnection) {
+        transportReplaced();
+        m_payloadStreams->reset();
+        m_heartbeat->reset();
+    }
 
     connect(socket, &QAbstractSocket::disconnected, this, &QObject::deleteLater);
     connect(m_socketLineReader, &SocketLineReader::readyRead, this, &LanDeviceLink::dataReceived);
+    connect(socket, &QIODevice::bytesWritten, this, &LanDeviceLink::transportWritten);
+    connect(socket, &QIODevice::bytesWritten, m_payloadStreams, &PayloadStreams::sendData);
 
     //We take ownership of the socket.
     //When the link provider destroys us,
@@ -58,6 +79,15 @@ void LanDeviceLink::reset(QSslSocket* socket, ConnectionStarted connectionSource
 
     QString certString = KdeConnectConfig::instance()->getDeviceProperty(deviceId(), QStringLiteral("certificate"));
     DeviceLink::setPairStatus(certString.isEmpty()? PairStatus::NotPaired : PairStatus::Paired);
+
+    //Anything that was waiting for the old connection goes through the new one
+    sendQueuedPackets();
+}
+
+bool LanDeviceLink::isAlive() const
+{
+    return m_socketLineReader->m_socket->state() == QAbstractSocket::ConnectedState
+           && m_lastReceived.isValid() && !m_lastReceived.hasExpired(s_aliveTime);
 }
 
 QHostAddress LanDeviceLink::hostAddress() const
@@ -84,58 +114,172 @@ QString LanDeviceLink::name()
 
 bool LanDeviceLink::sendPacket(NetworkPacket& np)
 {
+    quint32 streamId = 0;
     if (np.hasPayload()) {
-        np.setPayloadTransferInfo(sendPayload(np)->transferInfo());
+        //Small payloads go through this connection if the peer supports it, instead of a new one
+        if (hasLinkCapability(LINK_CAPABILITY_PAYLOAD_STREAMS)) {
+            streamId = m_payloadStreams->send(np.payload(), np.payloadSize());
+        }
+        if (streamId) {
+            np.setPayloadTransferInfo({{QStringLiteral("streamId"), streamId}});
+        } else {
+            np.setPayloadTransferInfo(sendPayload(np)->transferInfo());
+        }
     }
 
-    int written = m_socketLineReader->write(np.serialize());
-
     //Actually we can't detect if a packet is received or not. We keep TCP
     //"ESTABLISHED" connections that look legit (return true when we use them),
-    //but that are actually broken (until keepalive detects that they are down).
-    return (written != -1);
+    //but that are actually broken (until keepalive or the heartbeat detect that they are down).
+    m_heartbeat->trafficSent();
+    const bool queued = enqueuePacket(np, np.serialize(wireFormat()));
+    if (!queued && streamId) {
+        m_payloadStreams->cancel(streamId);
+    } else if (streamId) {
+        //Streams don't wait for the peer, the data goes after the packet
+        Q_EMIT payloadStarted(np.payload().data());
+    }
+    return queued;
+}
+
+void LanDeviceLink::sendStreamFrame(const QByteArray& frame, bool bulk)
+{
+    m_heartbeat->trafficSent();
+    enqueueFrame(frame, bulk);
+}
+
+void LanDeviceLink::sendHeartbeatFrame(const QByteArray& frame)
+{
+    enqueueFrame(frame, false);
+}
+
+void LanDeviceLink::heartbeatTimedOut()
+{
+    //Same as if TCP had noticed, the device will use another link or we'll connect again
+    m_socketLineReader->m_socket->abort();
+    deleteLater();
+}
+
+double LanDeviceLink::roundTripTime() const
+{
+    return m_heartbeat->roundTripTime();
+}
+
+double LanDeviceLink::roundTripJitter() const
+{
+    return m_heartbeat->roundTripJitter();
+}
+
+qint64 LanDeviceLink::transportBytesToWrite() const
+{
+    return m_socketLineReader->m_socket->bytesToWrite();
+}
+
+qint64 LanDeviceLink::writeToTransport(const char* data, qint64 size)
+{
+    return m_socketLineReader->m_socket->write(data, size);
 }
 
 UploadJob* LanDeviceLink::sendPayload(const NetworkPacket& np)
 {
     UploadJob* job = new UploadJob(np.payload(), deviceId());
+    if (hasLinkCapability(LINK_CAPABILITY_PAYLOAD_TOKENS)) {
+        LanLinkProvider* lanProvider = qobject_cast<LanLinkProvider*>(provider());
+        const QString token = lanProvider->registerUpload(job);
+        if (!token.isEmpty()) {
+            //A single connection doesn't fill a Wi-Fi link, big files go through several
+            const bool ranged = hasLinkCapability(LINK_CAPABILITY_PAYLOAD_RANGES)
+                                && np.payloadSize() >= UploadJob::s_minRangedSize
+                                && qobject_cast<QFile*>(np.payload().data());
+            job->setTransferToken(lanProvider->payloadPort(), token, ranged? UploadJob::s_maxRangeConnections : 1);
+        }
+    }
+    //Payloads of unknown size have no end to put it after
+    job->setChecksumTrailer(hasLinkCapability(LINK_CAPABILITY_PAYLOAD_CHECKSUMS) && np.payloadSize() > 0);
+    QPointer<QIODevice> payload = np.payload().data();
+    connect(job, &UploadJob::peerConnected, this, [this, payload]() {
+        if (payload) {
+            Q_EMIT payloadStarted(payload.data());
+        }
+    });
+    connect(job, &KJob::result, this, &LanDeviceLink::payloadSent);
     job->start();
     return job;
 }
 
+void LanDeviceLink::payloadSent(KJob* job)
+{
+    //Payloads go through connections of their own, the throughput of this one doesn't tell how fast they are
+    UploadJob* upload = static_cast<UploadJob*>(job);
+    const double throughput = upload->throughput();
+    if (job->error() || upload->sentBytes() < s_minThroughputSample || throughput <= 0) {
+        return;
+    }
+    m_payloadThroughput = m_payloadThroughput < 0? throughput : 0.75 * m_payloadThroughput + 0.25 * throughput;
+}
+
 void LanDeviceLink::dataReceived()
 {
-    if (m_socketLineReader->bytesAvailable() == 0) return;
+    m_lastReceived.start();
+    m_heartbeat->dataReceived();
 
-    const QByteArray serializedPacket = m_socketLineReader->readLine();
-    NetworkPacket packet(QString::null);
-    NetworkPacket::unserialize(serializedPacket, &packet);
+    //The reader has split everything it got from the socket, handle all of it now
+    //and give it to the device in a single batch
+    QVector<NetworkPacket> packets;
+    packets.reserve(int(m_socketLineReader->bytesAvailable()));
+    while (m_socketLineReader->bytesAvailable() > 0) {
+        //No copy: unserialize() doesn't keep references to this data
+        const QByteArray serializedPacket = m_socketLineReader->readLineView();
+        if (LinkHeartbeat::isHeartbeatFrame(serializedPacket)) {
+            m_heartbeat->frameReceived(serializedPacket);
+            continue;
+        }
+        m_heartbeat->trafficReceived();
+        if (PayloadStreams::isStreamFrame(serializedPacket)) {
+            m_payloadStreams->frameReceived(serializedPacket);
+            continue;
+        }
 
-    //qCDebug(KDECONNECT_CORE) << "LanDeviceLink dataReceived" << serializedPacket;
+        NetworkPacket packet(QString::null);
+        NetworkPacket::unserialize(serializedPacket, &packet, NetworkPacket::LazyBody);
 
-    if (packet.type() == PACKET_TYPE_PAIR) {
-        //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
-        qobject_cast<LanLinkProvider*>(provider())->incomingPairPacket(this, packet);
-        return;
-    }
+        //qCDebug(KDECONNECT_CORE) << "LanDeviceLink dataReceived" << serializedPacket;
 
-    if (packet.hasPayloadTransferInfo()) {
-        //qCDebug(KDECONNECT_CORE) << "HasPayloadTransferInfo";
-        QVariantMap transferInfo = packet.payloadTransferInfo();
-        //FIXME: The next two lines shouldn't be needed! Why are they here?
-        transferInfo.insert(QStringLiteral("useSsl"), true);
-        transferInfo.insert(QStringLiteral("deviceId"), deviceId());
-        DownloadJob* job = new DownloadJob(m_socketLineReader->peerAddress(), transferInfo);
-        job->start();
-        packet.setPayload(job->getPayload(), packet.payloadSize());
-    }
+        if (packet.type() == PACKET_TYPE_PAIR) {
+            //Whatever came before must be handled before the pairing status changes
+            if (!packets.isEmpty()) {
+                Q_EMIT receivedPackets(packets);
+                packets.clear();
+            }
+            //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
+            qobject_cast<LanLinkProvider*>(provider())->incomingPairPacket(this, packet);
+            continue;
+        }
 
-    Q_EMIT receivedPacket(packet);
+        if (packet.hasPayloadTransferInfo() && packet.payloadTransferInfo().contains(QStringLiteral("streamId"))) {
+            const quint32 streamId = packet.payloadTransferInfo().value(QStringLiteral("streamId")).toUInt();
+            packet.setPayload(m_payloadStreams->receive(streamId, packet.payloadSize()), packet.payloadSize());
+        } else if (packet.hasPayloadTransferInfo()) {
+            //qCDebug(KDECONNECT_CORE) << "HasPayloadTransferInfo";
+            QVariantMap transferInfo = packet.payloadTransferInfo();
+            //FIXME: The next two lines shouldn't be needed! Why are they here?
+            transferInfo.insert(QStringLiteral("useSsl"), true);
+            transferInfo.insert(QStringLiteral("deviceId"), deviceId());
+            //Lets the download resume if the connection drops
+            transferInfo.insert(QStringLiteral("size"), packet.payloadSize());
+            //The device starts them when there is room for another transfer (see TransferScheduler)
+            if (transferInfo.contains(QStringLiteral("rangeConnections"))) {
+                packet.setPayload(QSharedPointer<QIODevice>(new RangedDownload(m_socketLineReader->peerAddress(), transferInfo, packet.payloadSize())), packet.payloadSize());
+            } else {
+                packet.setPayload(QSharedPointer<QIODevice>(new DownloadPayload(m_socketLineReader->peerAddress(), transferInfo)), packet.payloadSize());
+            }
+        }
 
-    if (m_socketLineReader->bytesAvailable() > 0) {
-        QMetaObject::invokeMethod(this, "dataReceived", Qt::QueuedConnection);
+        packets.append(packet);
     }
 
+    if (!packets.isEmpty()) {
+        Q_EMIT receivedPackets(packets);
+    }
 }
 
 void LanDeviceLink::userRequestsPair()
@@ -165,6 +309,7 @@ void LanDeviceLink::setPairStatus(PairStatus status)
         Q_ASSERT(!m_socketLineReader->peerCertificate().isNull());
         KdeConnectConfig::instance()->setDeviceProperty(deviceId(), QStringLiteral("certificate"), m_socketLineReader->peerCertificate().toPem());
     }
+    LanLinkProvider::forgetSslState(deviceId());
 }
 
 bool LanDeviceLink::linkShouldBeKeptAlive() {
@@ -22,6 +22,7 @@
 #define LANDEVICELINK_H
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QString>
 #include <QSslSocket>
 #include <QSslCertificate>
@@ -31,6 +32,8 @@
 #include "uploadjob.h"
 
 class SocketLineReader;
+class PayloadStreams;
+class LinkHeartbeat;
 
 class KDECONNECTCORE_EXPORT LanDeviceLink
     : public DeviceLink
@@ -55,14 +58,37 @@ public:
     bool linkShouldBeKeptAlive() override;
 
     QHostAddress hostAddress() const;
+    //The connection is up and the peer sent us something in the last s_aliveTime ms
+    bool isAlive() const;
+
+    const static int s_aliveTime = 10000;
+
+    double roundTripTime() const override;
+    double roundTripJitter() const override;
+    double payloadThroughput() const override { return m_payloadThroughput; }
+
+    //Payloads smaller than this take mostly the time to connect, they don't tell how fast the link is
+    const static qint64 s_minThroughputSample = 1024 * 1024;
+
+protected:
+    qint64 transportBytesToWrite() const override;
+    qint64 writeToTransport(const char* data, qint64 size) override;
 
 private Q_SLOTS:
     void dataReceived();
+    void sendStreamFrame(const QByteArray& frame, bool bulk);
+    void sendHeartbeatFrame(const QByteArray& frame);
+    void heartbeatTimedOut();
+    void payloadSent(KJob* job);
 
 private:
     SocketLineReader* m_socketLineReader;
+    PayloadStreams* m_payloadStreams;
+    LinkHeartbeat* m_heartbeat;
     ConnectionStarted m_connectionSource;
     QHostAddress m_hostAddress;
+    QElapsedTimer m_lastReceived; //Invalid until the peer sends something through this connection
+    double m_payloadThroughput;
 };
 
 #endif
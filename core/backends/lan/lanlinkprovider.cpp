@@ -36,18 +36,90 @@
 #include <QNetworkConfigurationManager>
 #include <QSslCipher>
 #include <QSslConfiguration>
+#include <QSslKey>
+#include <QtCrypto>
 
 #include "daemon.h"
 #include "landevicelink.h"
 #include "lanpairinghandler.h"
 #include "kdeconnectconfig.h"
+#include "uploadjob.h"
 
 #define MIN_VERSION_WITH_SSL_SUPPORT 6
 
+//TLS sessions of trusted devices, so connecting to them again (the control link after a roam, or a
+//payload transfer) can skip the full handshake. Only used when we are the TLS client.
+static QHash<QString, QByteArray>& sslSessions()
+{
+    static QHash<QString, QByteArray> sessions;
+    return sessions;
+}
+
+//Everything but the session that goes into the SSL configuration of a socket, built once per trusted
+//device (and once for untrusted ones) instead of parsing keys and certificates for every socket
+static QHash<QString, QSslConfiguration>& sslConfigurations()
+{
+    static QHash<QString, QSslConfiguration> configurations;
+    return configurations;
+}
+
+static QSslConfiguration createSslConfiguration(const QString& deviceId, bool isDeviceTrusted)
+{
+    // Setting supported ciphers manually
+    // Top 3 ciphers are for new Android devices, botton two are for old Android devices
+    // FIXME : These cipher suites should be checked whether they are supported or not on device
+    QList<QSslCipher> socketCiphers;
+    socketCiphers.append(QSslCipher(QStringLiteral("ECDHE-ECDSA-AES256-GCM-SHA384")));
+    socketCiphers.append(QSslCipher(QStringLiteral("ECDHE-ECDSA-AES128-GCM-SHA256")));
+    socketCiphers.append(QSslCipher(QStringLiteral("ECDHE-RSA-AES128-SHA")));
+    socketCiphers.append(QSslCipher(QStringLiteral("RC4-SHA")));
+    socketCiphers.append(QSslCipher(QStringLiteral("RC4-MD5")));
+    socketCiphers.append(QSslCipher(QStringLiteral("DHE-RSA-AES256-SHA")));
+
+    KdeConnectConfig* config = KdeConnectConfig::instance();
+
+    QSslConfiguration sslConfig;
+    sslConfig.setCiphers(socketCiphers);
+    sslConfig.setProtocol(QSsl::TlsV1_0);
+    //Needed to get the session back after the handshake
+    sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    sslConfig.setLocalCertificate(config->certificate());
+    sslConfig.setPrivateKey(QSslKey(config->privateKey().toPEM().toLatin1(), QSsl::Rsa));
+
+    if (isDeviceTrusted) {
+        QString certString = config->getDeviceProperty(deviceId, QStringLiteral("certificate"), QString());
+        sslConfig.setCaCertificates({QSslCertificate(certString.toLatin1())});
+        sslConfig.setPeerVerifyMode(QSslSocket::VerifyPeer);
+    } else {
+        sslConfig.setPeerVerifyMode(QSslSocket::QueryPeer);
+    }
+
+    return sslConfig;
+}
+
+const int LanLinkProvider::s_identityBurst;
+const int LanLinkProvider::s_identityInterval;
+const int LanLinkProvider::s_maxIdentityBuckets;
+const int LanLinkProvider::s_identityDedupTime;
+
+//The same address as IPv4 if it's an IPv4-mapped IPv6 one, which is how dual stack sockets report them
+static QHostAddress plainAddress(const QHostAddress& address)
+{
+    bool isIPv4;
+    const quint32 ipv4 = address.toIPv4Address(&isIPv4);
+    return isIPv4? QHostAddress(ipv4) : address;
+}
+
 LanLinkProvider::LanLinkProvider(bool testMode)
-    : m_testMode(testMode)
+    : m_rateLimitedIdentities(0)
+    , m_duplicatedIdentities(0)
+    , m_identitiesWithLiveLink(0)
+    , m_testMode(testMode)
 {
+    m_identityClock.start();
     m_tcpPort = 0;
+    m_payloadPort = 0;
+    m_identityTcpPort = 0;
 
     m_combineBroadcastsTimer.setInterval(0); // increase this if waiting a single event-loop iteration is not enough
     m_combineBroadcastsTimer.setSingleShot(true);
@@ -59,6 +131,10 @@ LanLinkProvider::LanLinkProvider(bool testMode)
     m_server->setProxy(QNetworkProxy::NoProxy);
     connect(m_server,&QTcpServer::newConnection,this, &LanLinkProvider::newConnection);
 
+    m_payloadServer = new Server(this);
+    m_payloadServer->setProxy(QNetworkProxy::NoProxy);
+    connect(m_payloadServer, &QTcpServer::newConnection, this, &LanLinkProvider::newPayloadConnection);
+
     m_udpSocket.setProxy(QNetworkProxy::NoProxy);
 
     //Detect when a network interface changes status, so we announce ourelves in the new network
@@ -98,6 +174,17 @@ void LanLinkProvider::onStart()
         }
     }
 
+    //Shared by all the uploads to peers that support it, from the range used by the rest of them
+    m_payloadPort = UploadJob::MIN_PORT;
+    while (!m_payloadServer->listen(bindAddress, m_payloadPort)) {
+        m_payloadPort++;
+        if (m_payloadPort > UploadJob::MAX_PORT) {
+            qCWarning(KDECONNECT_CORE) << "Error opening a payload port in range" << UploadJob::MIN_PORT << "-" << UploadJob::MAX_PORT;
+            m_payloadPort = 0;
+            break;
+        }
+    }
+
     onNetworkChange();
 }
 
@@ -106,6 +193,8 @@ void LanLinkProvider::onStop()
     qCDebug(KDECONNECT_CORE) << "onStop";
     m_udpSocket.close();
     m_server->close();
+    m_payloadServer->close();
+    m_payloadPort = 0;
 }
 
 void LanLinkProvider::onNetworkChange()
@@ -130,13 +219,12 @@ void LanLinkProvider::broadcastToNetwork()
 
     qCDebug(KDECONNECT_CORE()) << "Broadcasting identity packet";
 
-    QHostAddress destAddress = m_testMode? QHostAddress::LocalHost : QHostAddress(QStringLiteral("255.255.255.255"));
-
-    NetworkPacket np(QLatin1String(""));
-    NetworkPacket::createIdentityPacket(&np);
-    np.set(QStringLiteral("tcpPort"), m_tcpPort);
+    const QByteArray identity = serializedIdentityPacket(true);
+    sendIdentityToKnownDevices(identity);
 
 #ifdef Q_OS_WIN
+    QHostAddress destAddress = m_testMode? QHostAddress::LocalHost : QHostAddress(QStringLiteral("255.255.255.255"));
+
     //On Windows we need to broadcast from every local IP address to reach all networks
     QUdpSocket sendSocket;
     sendSocket.setProxy(QNetworkProxy::NoProxy);
@@ -149,18 +237,61 @@ void LanLinkProvider::broadcastToNetwork()
                 if (sourceAddress.protocol() == QAbstractSocket::IPv4Protocol && sourceAddress != QHostAddress::LocalHost) {
                     qCDebug(KDECONNECT_CORE()) << "Broadcasting as" << sourceAddress;
                     sendSocket.bind(sourceAddress, UDP_PORT);
-                    sendSocket.writeDatagram(np.serialize(), destAddress, UDP_PORT);
+                    sendSocket.writeDatagram(identity, destAddress, UDP_PORT);
                     sendSocket.close();
                 }
             }
         }
     }
 #else
-    m_udpSocket.writeDatagram(np.serialize(), destAddress, UDP_PORT);
+    //255.255.255.255 only goes out through the interface of the default route
+    QList<QHostAddress> destAddresses = discoveryAddresses(QNetworkInterface::allInterfaces(), m_testMode);
+    if (destAddresses.isEmpty()) {
+        destAddresses.append(m_testMode? QHostAddress(QHostAddress::LocalHost) : QHostAddress(QStringLiteral("255.255.255.255")));
+    }
+    for (const QHostAddress& destAddress : qAsConst(destAddresses)) {
+        if (m_udpSocket.writeDatagram(identity, destAddress, UDP_PORT) < 0) {
+            qCDebug(KDECONNECT_CORE()) << "Couldn't broadcast to" << destAddress << m_udpSocket.errorString();
+        }
+    }
 #endif
 
 }
 
+QList<QHostAddress> LanLinkProvider::discoveryAddresses(const QList<QNetworkInterface>& interfaces, bool loopback)
+{
+    QList<QHostAddress> addresses;
+    for (const QNetworkInterface& iface : interfaces) {
+        const bool isLoopback = iface.flags() & QNetworkInterface::IsLoopback;
+        if (!(iface.flags() & QNetworkInterface::IsUp) || !(iface.flags() & QNetworkInterface::IsRunning) || isLoopback != loopback) {
+            continue;
+        }
+
+        bool hasLinkLocalIPv6 = false;
+        for (const QNetworkAddressEntry& entry : iface.addressEntries()) {
+            const QHostAddress ip = entry.ip();
+            if (ip.protocol() == QAbstractSocket::IPv4Protocol) {
+                //Loopback interfaces can't broadcast, but anything listening on them gets what we send to them
+                const QHostAddress destination = loopback? ip : entry.broadcast();
+                if (!destination.isNull() && !addresses.contains(destination)) {
+                    addresses.append(destination);
+                }
+            } else if (ip.protocol() == QAbstractSocket::IPv6Protocol) {
+                const Q_IPV6ADDR ipv6 = ip.toIPv6Address();
+                hasLinkLocalIPv6 |= (ipv6[0] == 0xfe && (ipv6[1] & 0xc0) == 0x80); //fe80::/10
+            }
+        }
+
+        //The IPv6 version of a broadcast is the all nodes group, which needs the interface to be reachable
+        if (hasLinkLocalIPv6 && !loopback && (iface.flags() & QNetworkInterface::CanMulticast)) {
+            QHostAddress allNodes(QStringLiteral("ff02::1"));
+            allNodes.setScopeId(iface.name());
+            addresses.append(allNodes);
+        }
+    }
+    return addresses;
+}
+
 //I'm the existing device, a new device is kindly introducing itself.
 //I will create a TcpSocket and try to connect. This can result in either connected() or connectError().
 void LanLinkProvider::newUdpConnection() //udpBroadcastReceived
@@ -176,6 +307,11 @@ void LanLinkProvider::newUdpConnection() //udpBroadcastReceived
         if (sender.isLoopback() && !m_testMode)
             continue;
 
+        //Before parsing, a device rebroadcasting in a loop shouldn't cost us anything
+        if (!takeIdentityToken(sender)) {
+            continue;
+        }
+
         NetworkPacket* receivedPacket = new NetworkPacket(QLatin1String(""));
         bool success = NetworkPacket::unserialize(datagram, receivedPacket);
 
@@ -194,20 +330,129 @@ void LanLinkProvider::newUdpConnection() //udpBroadcastReceived
             continue;
         }
 
+        const QString deviceId = receivedPacket->get<QString>(QStringLiteral("deviceId"));
+        //Devices with IPv4 and IPv6 send us their identity from both, we only need one connection
+        if (isConnectingTo(deviceId)) {
+            m_duplicatedIdentities++;
+            delete receivedPacket;
+            continue;
+        }
+
+        //A connection the device is still using doesn't need replacing. If it broke without us noticing,
+        //nothing arrives through it anymore and we connect again on a later identity.
+        LanDeviceLink* link = m_links.value(deviceId);
+        if (link && link->isAlive() && plainAddress(link->hostAddress()) == plainAddress(sender)) {
+            m_identitiesWithLiveLink++;
+            delete receivedPacket;
+            continue;
+        }
+
         int tcpPort = receivedPacket->get<int>(QStringLiteral("tcpPort"));
 
         //qCDebug(KDECONNECT_CORE) << "Received Udp identity packet from" << sender << " asking for a tcp connection on port " << tcpPort;
 
-        QSslSocket* socket = new QSslSocket(this);
-        socket->setProxy(QNetworkProxy::NoProxy);
-        m_receivedIdentityPackets[socket].np = receivedPacket;
-        m_receivedIdentityPackets[socket].sender = sender;
-        connect(socket, &QAbstractSocket::connected, this, &LanLinkProvider::connected);
-        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(connectError()));
-        socket->connectToHost(sender, tcpPort);
+        connectToDevice(receivedPacket, sender, quint16(tcpPort));
     }
 }
 
+//Takes ownership of identity
+void LanLinkProvider::connectToDevice(NetworkPacket* identity, const QHostAddress& address, quint16 port)
+{
+    const QString deviceId = identity->get<QString>(QStringLiteral("deviceId"));
+
+    QSslSocket* socket = new QSslSocket(this);
+    socket->setProxy(QNetworkProxy::NoProxy);
+    m_receivedIdentityPackets[socket].np = identity;
+    m_receivedIdentityPackets[socket].sender = address;
+    m_recentIdentities.insert(deviceId, {socket, m_identityClock.elapsed()});
+    connect(socket, &QAbstractSocket::connected, this, &LanLinkProvider::connected);
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(connectError()));
+    socket->connectToHost(address, port);
+}
+
+//Trusted devices are probably where we left them, no need to wait for a broadcast to reach them.
+//They connect to us like if it had, with the identity they have now.
+void LanLinkProvider::sendIdentityToKnownDevices(const QByteArray& identity)
+{
+    KdeConnectConfig* config = KdeConnectConfig::instance();
+    const QStringList trustedDevices = config->trustedDevices();
+    for (const QString& deviceId : trustedDevices) {
+        LanDeviceLink* link = m_links.value(deviceId);
+        if (link && link->isAlive()) {
+            continue;
+        }
+
+        const QHostAddress address = config->getLastAddress(deviceId);
+        if (address.isNull()) {
+            continue;
+        }
+
+        qCDebug(KDECONNECT_CORE) << "Sending our identity to" << deviceId << "at its last address" << address;
+        if (m_udpSocket.writeDatagram(identity, address, UDP_PORT) < 0) {
+            qCDebug(KDECONNECT_CORE()) << "Couldn't send our identity to" << address << m_udpSocket.errorString();
+        }
+    }
+}
+
+void LanLinkProvider::rememberAddress(const QString& deviceId, LanDeviceLink* link)
+{
+    KdeConnectConfig* config = KdeConnectConfig::instance();
+    if (config->trustedDevices().contains(deviceId)) {
+        config->setLastAddress(deviceId, plainAddress(link->hostAddress()));
+    }
+}
+
+bool LanLinkProvider::takeIdentityToken(const QHostAddress& sender)
+{
+    const qint64 now = m_identityClock.elapsed();
+    const QHostAddress address = plainAddress(sender);
+
+    auto it = m_identityBuckets.find(address);
+    if (it == m_identityBuckets.end()) {
+        //Instead of keeping every address we ever saw, forget the one we saw first. Looking for the
+        //full buckets would cost a lot with every new address of a flood of spoofed ones.
+        if (m_identityBuckets.size() >= s_maxIdentityBuckets) {
+            m_identityBuckets.remove(m_identityBucketOrder.dequeue());
+        }
+        m_identityBucketOrder.enqueue(address);
+        it = m_identityBuckets.insert(address, {s_identityBurst, now, false});
+    }
+
+    const qint64 refills = (now - it->refilled) / s_identityInterval;
+    if (refills > 0) {
+        it->tokens = int(qMin<qint64>(s_identityBurst, it->tokens + refills));
+        it->refilled += refills * s_identityInterval;
+    }
+    if (it->tokens == 0) {
+        m_rateLimitedIdentities++;
+        //Once per burst, a flood would fill the log otherwise
+        if (!it->throttled) {
+            it->throttled = true;
+            qCDebug(KDECONNECT_CORE) << "Ignoring identities from" << address << "for a while, it sends too many."
+                                     << "Identities not answered so far: rate limited" << m_rateLimitedIdentities
+                                     << "duplicated" << m_duplicatedIdentities << "with a live link" << m_identitiesWithLiveLink;
+        }
+        return false;
+    }
+    it->throttled = false;
+    it->tokens--;
+    return true;
+}
+
+bool LanLinkProvider::isConnectingTo(const QString& deviceId)
+{
+    const qint64 now = m_identityClock.elapsed();
+    for (auto it = m_recentIdentities.begin(); it != m_recentIdentities.end();) {
+        //Done with the socket once the link is created or we give up
+        if (!it->socket || !m_receivedIdentityPackets.contains(it->socket) || now - it->received >= s_identityDedupTime) {
+            it = m_recentIdentities.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return m_recentIdentities.contains(deviceId);
+}
+
 void LanLinkProvider::connectError()
 {
     QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
@@ -216,10 +461,7 @@ void LanLinkProvider::connectError()
     disconnect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(connectError()));
 
     qCDebug(KDECONNECT_CORE) << "Fallback (1), try reverse connection (send udp packet)" << socket->errorString();
-    NetworkPacket np(QLatin1String(""));
-    NetworkPacket::createIdentityPacket(&np);
-    np.set(QStringLiteral("tcpPort"), m_tcpPort);
-    m_udpSocket.writeDatagram(np.serialize(), m_receivedIdentityPackets[socket].sender, UDP_PORT);
+    m_udpSocket.writeDatagram(serializedIdentityPacket(true), m_receivedIdentityPackets[socket].sender, UDP_PORT);
 
     //The socket we created didn't work, and we didn't manage
     //to create a LanDeviceLink from it, deleting everything.
@@ -246,9 +488,7 @@ void LanLinkProvider::connected()
     //qCDebug(KDECONNECT_CORE) << "Connected" << socket->isWritable();
 
     // If network is on ssl, do not believe when they are connected, believe when handshake is completed
-    NetworkPacket np2(QLatin1String(""));
-    NetworkPacket::createIdentityPacket(&np2);
-    socket->write(np2.serialize());
+    socket->write(serializedIdentityPacket(false));
     bool success = socket->waitForBytesWritten();
 
     if (success) {
@@ -318,6 +558,7 @@ void LanLinkProvider::sslErrors(const QList<QSslError>& errors)
     disconnect(socket, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrors(QList<QSslError>)));
 
     qCDebug(KDECONNECT_CORE) << "Failing due to " << errors;
+    forgetSslState(socket->peerVerifyName());
     Device* device = Daemon::instance()->getDevice(socket->peerVerifyName());
     if (device) {
         device->unpair();
@@ -346,6 +587,72 @@ void LanLinkProvider::newConnection()
     }
 }
 
+QString LanLinkProvider::registerUpload(UploadJob* job)
+{
+    if (m_payloadPort == 0) {
+        return QString();
+    }
+
+    const QString token = QString::fromLatin1(QCA::Random::randomArray(16).toByteArray().toHex());
+    m_pendingUploads.insert(token, job);
+    connect(job, &KJob::finished, this, [this, token]() {
+        m_pendingUploads.remove(token);
+    });
+    return token;
+}
+
+//A peer wants to download a payload, it will tell us which one with a token
+void LanLinkProvider::newPayloadConnection()
+{
+    while (m_payloadServer->hasPendingConnections()) {
+        QSslSocket* socket = m_payloadServer->nextPendingConnection();
+        connect(socket, &QAbstractSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QIODevice::readyRead, this, &LanLinkProvider::payloadTokenReceived);
+
+        QTimer::singleShot(s_payloadTokenTimeout, socket, [this, socket]() {
+            //Still ours, so no upload took it
+            if (socket->parent() == this) {
+                qCDebug(KDECONNECT_CORE) << "No payload token received from" << socket->peerAddress();
+                socket->abort();
+                socket->deleteLater();
+            }
+        });
+    }
+}
+
+void LanLinkProvider::payloadTokenReceived()
+{
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+
+    if (!socket->canReadLine()) {
+        //Tokens are short, this is not a peer we want to talk to
+        if (socket->bytesAvailable() > 128) {
+            socket->abort();
+        }
+        return;
+    }
+
+    //The peer waits for us to start encrypting after the token, so there is nothing else to read
+    //Downloads that are resuming also send where they want to continue from and the checksum of what they have
+    const QList<QByteArray> request = socket->readLine().trimmed().split(' ');
+    const QString token = QString::fromLatin1(request.at(0));
+    const qint64 offset = request.size() == 3? request.at(1).toLongLong() : 0;
+    const QByteArray checksum = request.size() == 3? QByteArray::fromHex(request.at(2)) : QByteArray();
+    disconnect(socket, &QIODevice::readyRead, this, &LanLinkProvider::payloadTokenReceived);
+
+    //Uploads over several connections get the same token in each, so it stays until the upload finishes
+    UploadJob* job = m_pendingUploads.value(token);
+    if (!job) {
+        qCWarning(KDECONNECT_CORE) << "Received unknown payload token from" << socket->peerAddress();
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+
+    disconnect(socket, &QAbstractSocket::disconnected, socket, &QObject::deleteLater);
+    job->connectionReceived(socket, offset, checksum);
+}
+
 //I'm the new device and this is the answer to my UDP identity packet (data received)
 void LanLinkProvider::dataReceived()
 {
@@ -419,33 +726,32 @@ void LanLinkProvider::deviceLinkDestroyed(QObject* destroyedDeviceLink)
 
 void LanLinkProvider::configureSslSocket(QSslSocket* socket, const QString& deviceId, bool isDeviceTrusted)
 {
-    // Setting supported ciphers manually
-    // Top 3 ciphers are for new Android devices, botton two are for old Android devices
-    // FIXME : These cipher suites should be checked whether they are supported or not on device
-    QList<QSslCipher> socketCiphers;
-    socketCiphers.append(QSslCipher(QStringLiteral("ECDHE-ECDSA-AES256-GCM-SHA384")));
-    socketCiphers.append(QSslCipher(QStringLiteral("ECDHE-ECDSA-AES128-GCM-SHA256")));
-    socketCiphers.append(QSslCipher(QStringLiteral("ECDHE-RSA-AES128-SHA")));
-    socketCiphers.append(QSslCipher(QStringLiteral("RC4-SHA")));
-    socketCiphers.append(QSslCipher(QStringLiteral("RC4-MD5")));
-    socketCiphers.append(QSslCipher(QStringLiteral("DHE-RSA-AES256-SHA")));
+    //Untrusted devices all share the configuration stored under an empty id
+    const QString cacheKey = isDeviceTrusted ? deviceId : QString();
+    auto it = sslConfigurations().find(cacheKey);
+    if (it == sslConfigurations().end()) {
+        it = sslConfigurations().insert(cacheKey, createSslConfiguration(deviceId, isDeviceTrusted));
+    }
 
-    // Configure for ssl
-    QSslConfiguration sslConfig;
-    sslConfig.setCiphers(socketCiphers);
-    sslConfig.setProtocol(QSsl::TlsV1_0);
+    QSslConfiguration sslConfig = *it;
+    if (isDeviceTrusted) {
+        sslConfig.setSessionTicket(sslSessions().value(deviceId));
+    }
 
     socket->setSslConfiguration(sslConfig);
-    socket->setLocalCertificate(KdeConnectConfig::instance()->certificate());
-    socket->setPrivateKey(KdeConnectConfig::instance()->privateKeyPath());
     socket->setPeerVerifyName(deviceId);
 
     if (isDeviceTrusted) {
-        QString certString = KdeConnectConfig::instance()->getDeviceProperty(deviceId, QStringLiteral("certificate"), QString());
-        socket->addCaCertificate(QSslCertificate(certString.toLatin1()));
-        socket->setPeerVerifyMode(QSslSocket::VerifyPeer);
-    } else {
-        socket->setPeerVerifyMode(QSslSocket::QueryPeer);
+        QObject::connect(socket, &QSslSocket::encrypted, socket, [socket, deviceId]() {
+            //Sessions we handed out as a server can't be used to resume as a client
+            if (socket->mode() != QSslSocket::SslClientMode) {
+                return;
+            }
+            const QByteArray session = socket->sslConfiguration().sessionTicket();
+            if (!session.isEmpty()) {
+                sslSessions().insert(deviceId, session);
+            }
+        });
     }
 
     //Usually SSL errors are only bad for trusted devices. Uncomment this section to log errors in any case, for debugging.
@@ -457,6 +763,12 @@ void LanLinkProvider::configureSslSocket(QSslSocket* socket, const QString& devi
     //});
 }
 
+void LanLinkProvider::forgetSslState(const QString& deviceId)
+{
+    sslConfigurations().remove(deviceId);
+    sslSessions().remove(deviceId);
+}
+
 void LanLinkProvider::configureSocket(QSslSocket* socket) {
 
     socket->setProxy(QNetworkProxy::NoProxy);
@@ -506,9 +818,27 @@ void LanLinkProvider::addLink(const QString& deviceId, QSslSocket* socket, Netwo
             m_pairingHandlers[deviceId]->setDeviceLink(deviceLink);
         }
     }
+    deviceLink->setPeerIdentity(*receivedPacket);
+    rememberAddress(deviceId, deviceLink);
     Q_EMIT onConnectionReceived(*receivedPacket, deviceLink);
 }
 
+QByteArray LanLinkProvider::serializedIdentityPacket(bool withTcpPort)
+{
+    //We send our identity on every broadcast and every connection, only serialize it again when it changes
+    const QString name = KdeConnectConfig::instance()->name();
+    if (m_identity.isEmpty() || name != m_identityName || m_tcpPort != m_identityTcpPort) {
+        NetworkPacket np(QLatin1String(""));
+        NetworkPacket::createIdentityPacket(&np, linkCapabilities());
+        m_identity = np.serialize();
+        np.set(QStringLiteral("tcpPort"), m_tcpPort);
+        m_identityWithTcpPort = np.serialize();
+        m_identityName = name;
+        m_identityTcpPort = m_tcpPort;
+    }
+    return withTcpPort? m_identityWithTcpPort : m_identity;
+}
+
 LanPairingHandler* LanLinkProvider::createPairingHandler(DeviceLink* link)
 {
     LanPairingHandler* ph = m_pairingHandlers.value(link->deviceId());
@@ -22,12 +22,16 @@
 #define LANLINKPROVIDER_H
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QTcpServer>
 #include <QSslSocket>
 #include <QUdpSocket>
 #include <QTimer>
+#include <QNetworkInterface>
 #include <QNetworkSession>
 #include <QSslSocket>
+#include <QPointer>
+#include <QQueue>
 
 #include "kdeconnectcore_export.h"
 #include "backends/linkprovider.h"
@@ -35,6 +39,7 @@
 #include "landevicelink.h"
 
 class LanPairingHandler;
+class UploadJob;
 class KDECONNECTCORE_EXPORT LanLinkProvider
     : public LinkProvider
 {
@@ -46,6 +51,7 @@ public:
 
     QString name() override { return QStringLiteral("LanLinkProvider"); }
     int priority() override { return PRIORITY_HIGH; }
+    QStringList linkCapabilities() const override { return NetworkPacket::linkCapabilities(); }
 
     void userRequestsPair(const QString& deviceId);
     void userRequestsUnpair(const QString& deviceId);
@@ -53,10 +59,38 @@ public:
 
     static void configureSslSocket(QSslSocket* socket, const QString& deviceId, bool isDeviceTrusted);
     static void configureSocket(QSslSocket* socket);
+    //Drops the SSL configuration and TLS session we keep for this device, to be called when
+    //its certificate is stored or removed
+    static void forgetSslState(const QString& deviceId);
+
+    //Makes job wait for the peer on our payload port, instead of listening on a port of its own.
+    //Returns the token the peer has to send after connecting, or an empty string if we have no payload port.
+    QString registerUpload(UploadJob* job);
+    quint16 payloadPort() const { return m_payloadPort; }
+
+    //Where we send our identity when broadcasting: the broadcast address of each IPv4 network we
+    //are in, and the link-local all nodes group of each interface with IPv6. With loopback, only
+    //the IPv4 addresses of the loopback interfaces instead.
+    static QList<QHostAddress> discoveryAddresses(const QList<QNetworkInterface>& interfaces, bool loopback);
 
     const static quint16 UDP_PORT = 1716;
     const static quint16 MIN_TCP_PORT = 1716;
     const static quint16 MAX_TCP_PORT = 1764;
+    //Connections to the payload port are closed if they don't send a token in time
+    const static int s_payloadTokenTimeout = 10 * 1000;
+
+    //Each address can send us s_identityBurst identity datagrams at once, and one more every s_identityInterval
+    const static int s_identityBurst = 5;
+    const static int s_identityInterval = 1000;
+    const static int s_maxIdentityBuckets = 1024;
+    //Identities of a device we are still connecting to are ignored, for this long at most
+    const static int s_identityDedupTime = 5000;
+
+    //Identity datagrams we didn't answer, because their sender sent too many, we were already
+    //connecting to that device, or we have a link to it that is working
+    quint64 rateLimitedIdentities() const { return m_rateLimitedIdentities; }
+    quint64 duplicatedIdentities() const { return m_duplicatedIdentities; }
+    quint64 identitiesWithLiveLink() const { return m_identitiesWithLiveLink; }
 
 public Q_SLOTS:
     void onNetworkChange() override;
@@ -70,6 +104,8 @@ private Q_SLOTS:
     void newUdpConnection();
     void newConnection();
     void dataReceived();
+    void newPayloadConnection();
+    void payloadTokenReceived();
     void deviceLinkDestroyed(QObject* destroyedDeviceLink);
     void sslErrors(const QList<QSslError>& errors);
     void broadcastToNetwork();
@@ -79,11 +115,21 @@ private:
 
     void onNetworkConfigurationChanged(const QNetworkConfiguration& config);
     void addLink(const QString& deviceId, QSslSocket* socket, NetworkPacket* receivedPacket, LanDeviceLink::ConnectionStarted connectionOrigin);
+    QByteArray serializedIdentityPacket(bool withTcpPort);
+    bool takeIdentityToken(const QHostAddress& sender);
+    void connectToDevice(NetworkPacket* identity, const QHostAddress& address, quint16 port);
+    void sendIdentityToKnownDevices(const QByteArray& identity);
+    void rememberAddress(const QString& deviceId, LanDeviceLink* link);
+    bool isConnectingTo(const QString& deviceId);
 
     Server* m_server;
     QUdpSocket m_udpSocket;
     quint16 m_tcpPort;
 
+    Server* m_payloadServer;
+    quint16 m_payloadPort;
+    QHash<QString, QPointer<UploadJob>> m_pendingUploads;
+
     QMap<QString, LanDeviceLink*> m_links;
     QMap<QString, LanPairingHandler*> m_pairingHandlers;
 
@@ -92,9 +138,32 @@ private:
         QHostAddress sender;
     };
     QMap<QSslSocket*, PendingConnect> m_receivedIdentityPackets;
+
+    struct IdentityBucket {
+        int tokens;
+        qint64 refilled; //When the last token was added
+        bool throttled; //Logged already, until it gets a token again
+    };
+    QHash<QHostAddress, IdentityBucket> m_identityBuckets;
+    QQueue<QHostAddress> m_identityBucketOrder; //Oldest first
+    struct RecentIdentity {
+        QPointer<QSslSocket> socket; //The connection we opened in answer to it
+        qint64 received;
+    };
+    QHash<QString, RecentIdentity> m_recentIdentities; //By deviceId, whatever address it came from
+    QElapsedTimer m_identityClock;
+    quint64 m_rateLimitedIdentities;
+    quint64 m_duplicatedIdentities;
+    quint64 m_identitiesWithLiveLink;
     QNetworkConfiguration m_lastConfig;
     const bool m_testMode;
     QTimer m_combineBroadcastsTimer;
+
+    //Our identity packet, serialized for the name and port in m_identityName and m_identityTcpPort
+    QByteArray m_identity;
+    QByteArray m_identityWithTcpPort;
+    QString m_identityName;
+    quint16 m_identityTcpPort;
 };
 
 #endif
@@ -0,0 +1,178 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "linkheartbeat.h"
+
+#include <QtEndian>
+
+#include "backends/devicelink.h"
+#include "core_debug.h"
+
+const int LinkHeartbeat::s_activeInterval;
+const int LinkHeartbeat::s_idleInterval;
+const int LinkHeartbeat::s_activeTime;
+const int LinkHeartbeat::s_minDeadTime;
+const int LinkHeartbeat::s_idleDeadTime;
+
+LinkHeartbeat::LinkHeartbeat(DeviceLink* link)
+    : QObject(link)
+    , m_link(link)
+    , m_pingSent(-1)
+    , m_pingBacklog(0)
+    , m_lastPing(0)
+    , m_lastReceived(0)
+    , m_lastTraffic(-1)
+    , m_rtt(-1)
+    , m_rttVariance(0)
+{
+    m_clock.start();
+    m_timer.setInterval(s_idleInterval);
+    connect(&m_timer, &QTimer::timeout, this, &LinkHeartbeat::check);
+    connect(link, &DeviceLink::linkCapabilitiesChanged, this, &LinkHeartbeat::linkCapabilitiesChanged);
+    linkCapabilitiesChanged();
+}
+
+bool LinkHeartbeat::isHeartbeatFrame(const QByteArray& frame)
+{
+    return !frame.isEmpty() && (frame.at(0) == NetworkPacket::s_heartbeatPingMarker || frame.at(0) == NetworkPacket::s_heartbeatPongMarker);
+}
+
+void LinkHeartbeat::frameReceived(const QByteArray& frame)
+{
+    if (frame.size() != NetworkPacket::s_frameHeaderSize + 8 || NetworkPacket::binaryFrameSize(frame.constData(), frame.size()) != frame.size()) {
+        qCWarning(KDECONNECT_CORE) << "Ignoring malformed heartbeat frame";
+        return;
+    }
+
+    const quint64 timestamp = qFromBigEndian<quint64>(reinterpret_cast<const uchar*>(frame.constData() + NetworkPacket::s_frameHeaderSize));
+    if (frame.at(0) == NetworkPacket::s_heartbeatPingMarker) {
+        Q_EMIT frameReady(createFrame(NetworkPacket::s_heartbeatPongMarker, timestamp));
+    } else if (m_pingSent >= 0 && qint64(timestamp) == m_pingSent) {
+        addSample(now() - m_pingSent);
+        m_pingSent = -1;
+    }
+}
+
+void LinkHeartbeat::dataReceived()
+{
+    m_lastReceived = now();
+}
+
+void LinkHeartbeat::trafficReceived()
+{
+    m_lastTraffic = now();
+    setInterval(s_activeInterval);
+}
+
+void LinkHeartbeat::trafficSent()
+{
+    m_lastTraffic = now();
+    setInterval(s_activeInterval);
+}
+
+void LinkHeartbeat::linkCapabilitiesChanged()
+{
+    if (!m_link->hasLinkCapability(LINK_CAPABILITY_HEARTBEAT)) {
+        m_timer.stop();
+        m_pingSent = -1;
+    } else if (!m_timer.isActive()) {
+        m_lastReceived = now();
+        m_timer.start();
+    }
+}
+
+void LinkHeartbeat::setInterval(int interval)
+{
+    //Starting it again every time there's traffic would never let it fire
+    if (m_timer.isActive() && m_timer.interval() != interval) {
+        m_timer.start(interval);
+    }
+}
+
+void LinkHeartbeat::reset()
+{
+    m_pingSent = -1;
+    m_lastReceived = now();
+}
+
+double LinkHeartbeat::roundTripTime() const
+{
+    return m_rtt < 0? -1 : m_rtt / 1000;
+}
+
+double LinkHeartbeat::roundTripJitter() const
+{
+    return m_rtt < 0? -1 : m_rttVariance / 1000;
+}
+
+void LinkHeartbeat::addSample(qint64 rtt)
+{
+    if (m_rtt < 0) {
+        m_rtt = rtt;
+        m_rttVariance = rtt / 2.0;
+    } else {
+        m_rttVariance = 0.75 * m_rttVariance + 0.25 * qAbs(m_rtt - rtt);
+        m_rtt = 0.875 * m_rtt + 0.125 * rtt;
+    }
+}
+
+void LinkHeartbeat::check()
+{
+    const qint64 time = now();
+    const bool active = m_lastTraffic >= 0 && time - m_lastTraffic < s_activeTime * 1000LL;
+    const int interval = active? s_activeInterval : s_idleInterval;
+    setInterval(interval);
+
+    //One ping at a time, the next one goes when it's answered
+    if (m_pingSent >= 0) {
+        qint64 deadTime = s_idleDeadTime * 1000LL;
+        if (active && m_rtt >= 0) {
+            deadTime = qMax(s_minDeadTime * 1000LL, qint64(2 * m_rtt + 4 * m_rttVariance));
+        }
+        //The ping waits for what was queued before it, and so does the pong
+        if (m_pingBacklog > 0) {
+            const double throughput = m_link->throughput();
+            deadTime = throughput > 0? deadTime + qint64(m_pingBacklog * 1e6 / throughput) : qMax(deadTime, s_idleDeadTime * 1000LL);
+        }
+        if (time - m_pingSent > deadTime && time - m_lastReceived > deadTime) {
+            qCWarning(KDECONNECT_CORE) << "Link to" << m_link->deviceId() << "silent for" << (time - m_lastReceived) / 1000 << "ms, giving up on it";
+            m_pingSent = -1;
+            Q_EMIT linkDead();
+        }
+        return;
+    }
+
+    //The timer may fire a little early
+    if (time - m_lastPing >= (interval - s_activeInterval / 2) * 1000LL) {
+        m_pingSent = m_lastPing = time;
+        m_pingBacklog = m_link->interactiveBacklog();
+        Q_EMIT frameReady(createFrame(NetworkPacket::s_heartbeatPingMarker, quint64(time)));
+    }
+}
+
+QByteArray LinkHeartbeat::createFrame(char marker, quint64 timestamp)
+{
+    QByteArray frame(NetworkPacket::s_frameHeaderSize + 8, Qt::Uninitialized);
+    uchar* header = reinterpret_cast<uchar*>(frame.data());
+    header[0] = uchar(marker);
+    qToBigEndian<quint32>(8, header + 1);
+    qToBigEndian<quint64>(timestamp, header + NetworkPacket::s_frameHeaderSize);
+    return frame;
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINKHEARTBEAT_H
+#define LINKHEARTBEAT_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <kdeconnectcore_export.h>
+
+class DeviceLink;
+
+/*
+ * Pings the other end of a link that negotiated heartbeats, to measure its round trip time and
+ * to notice it's gone long before TCP does.
+ *
+ * Pings and pongs are frames with the header of binary packets followed by a big endian 64 bit
+ * timestamp, that the pong sends back as it was. Only our clock gives them meaning.
+ *
+ * While traffic is flowing we ping every s_activeInterval, and the link is dead if it doesn't
+ * answer nor send anything else for twice the round trip time (plus four times its variation,
+ * like TCP), but never less than s_minDeadTime. When idle we ping every s_idleInterval and give
+ * it s_idleDeadTime. Either way the deadline grows by the time the link needs to write what was
+ * queued ahead of the ping, at the throughput it measured. Links that didn't negotiate heartbeats
+ * don't even run the timer.
+ */
+class KDECONNECTCORE_EXPORT LinkHeartbeat
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LinkHeartbeat(DeviceLink* link);
+
+    static bool isHeartbeatFrame(const QByteArray& frame);
+    void frameReceived(const QByteArray& frame);
+
+    //The link tells us what goes through it
+    void dataReceived();
+    void trafficReceived();
+    void trafficSent();
+    //For a new connection, the ping we are waiting for won't come through it
+    void reset();
+
+    //Smoothed like TCP does (RFC 6298), in milliseconds. -1 until the first pong.
+    double roundTripTime() const;
+    double roundTripJitter() const;
+
+    const static int s_activeInterval = 250;
+    const static int s_idleInterval = 5000;
+    const static int s_activeTime = 1000; //Traffic flows if something went through in this time
+    const static int s_minDeadTime = 600;
+    const static int s_idleDeadTime = 15000;
+
+Q_SIGNALS:
+    //To send ahead of the bulk data
+    void frameReady(const QByteArray& frame);
+    void linkDead();
+
+private Q_SLOTS:
+    void check();
+    void linkCapabilitiesChanged();
+
+private:
+    static QByteArray createFrame(char marker, quint64 timestamp);
+    qint64 now() const { return m_clock.nsecsElapsed() / 1000; }
+    void addSample(qint64 rtt);
+    void setInterval(int interval);
+
+    DeviceLink* m_link;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+
+    //Microseconds of m_clock
+    qint64 m_pingSent; //Of the ping we are waiting for, -1 if none
+    qint64 m_pingBacklog; //Bytes the link had to write before the ping
+    qint64 m_lastPing;
+    qint64 m_lastReceived;
+    qint64 m_lastTraffic; //-1 if there wasn't any yet
+
+    double m_rtt;
+    double m_rttVariance;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadchecksum.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+const int PayloadChecksum::s_trailerSize;
+
+static const quint64 PRIME1 = 0x9E3779B185EBCA87ULL;
+static const quint64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const quint64 PRIME3 = 0x165667B19E3779F9ULL;
+static const quint64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const quint64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 mixLane(quint64 lane, quint64 input)
+{
+    lane += input * PRIME2;
+    return rotateLeft(lane, 31) * PRIME1;
+}
+
+static inline quint64 mergeRound(quint64 hash, quint64 lane)
+{
+    hash ^= mixLane(0, lane);
+    return hash * PRIME1 + PRIME4;
+}
+
+//The four lanes are independent, so the compiler can keep them all in flight
+static inline void consumeStripe(quint64* lanes, const uchar* stripe)
+{
+    lanes[0] = mixLane(lanes[0], qFromLittleEndian<quint64>(stripe));
+    lanes[1] = mixLane(lanes[1], qFromLittleEndian<quint64>(stripe + 8));
+    lanes[2] = mixLane(lanes[2], qFromLittleEndian<quint64>(stripe + 16));
+    lanes[3] = mixLane(lanes[3], qFromLittleEndian<quint64>(stripe + 24));
+}
+
+PayloadChecksum::PayloadChecksum()
+{
+    reset();
+}
+
+void PayloadChecksum::reset()
+{
+    m_lanes[0] = PRIME1 + PRIME2;
+    m_lanes[1] = PRIME2;
+    m_lanes[2] = 0;
+    m_lanes[3] = 0 - PRIME1;
+    m_length = 0;
+    m_pendingSize = 0;
+}
+
+void PayloadChecksum::addData(const char* data, qint64 size)
+{
+    const uchar* input = reinterpret_cast<const uchar*>(data);
+    const uchar* end = input + size;
+    m_length += quint64(size);
+
+    if (m_pendingSize + size < 32) {
+        std::memcpy(m_pending + m_pendingSize, input, size_t(size));
+        m_pendingSize += int(size);
+        return;
+    }
+
+    if (m_pendingSize > 0) {
+        const int missing = 32 - m_pendingSize;
+        std::memcpy(m_pending + m_pendingSize, input, size_t(missing));
+        consumeStripe(m_lanes, m_pending);
+        input += missing;
+        m_pendingSize = 0;
+    }
+
+    while (end - input >= 32) {
+        consumeStripe(m_lanes, input);
+        input += 32;
+    }
+
+    m_pendingSize = int(end - input);
+    std::memcpy(m_pending, input, size_t(m_pendingSize));
+}
+
+quint64 PayloadChecksum::result() const
+{
+    quint64 hash;
+    if (m_length >= 32) {
+        hash = rotateLeft(m_lanes[0], 1) + rotateLeft(m_lanes[1], 7) + rotateLeft(m_lanes[2], 12) + rotateLeft(m_lanes[3], 18);
+        for (quint64 lane : m_lanes) {
+            hash = mergeRound(hash, lane);
+        }
+    } else {
+        hash = PRIME5;
+    }
+    hash += m_length;
+
+    const uchar* input = m_pending;
+    const uchar* end = m_pending + m_pendingSize;
+    while (end - input >= 8) {
+        hash ^= mixLane(0, qFromLittleEndian<quint64>(input));
+        hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+        input += 8;
+    }
+    if (end - input >= 4) {
+        hash ^= quint64(qFromLittleEndian<quint32>(input)) * PRIME1;
+        hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+        input += 4;
+    }
+    while (input < end) {
+        hash ^= quint64(*input) * PRIME5;
+        hash = rotateLeft(hash, 11) * PRIME1;
+        ++input;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
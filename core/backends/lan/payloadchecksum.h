@@ -0,0 +1,54 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADCHECKSUM_H
+#define PAYLOADCHECKSUM_H
+
+#include <QByteArray>
+
+#include <kdeconnectcore_export.h>
+
+/*
+ * XXH64 (seed 0) of a payload, computed as it is sent or received.
+ *
+ * Uploads to peers that support it end with the big endian checksum of the whole payload
+ * (see UploadJob and DownloadPayload). It only has to catch corruption, not tampering, TLS
+ * takes care of that.
+ */
+class KDECONNECTCORE_EXPORT PayloadChecksum
+{
+public:
+    PayloadChecksum();
+
+    void reset();
+    void addData(const char* data, qint64 size);
+    void addData(const QByteArray& data) { addData(data.constData(), data.size()); }
+    quint64 result() const;
+
+    const static int s_trailerSize = 8;
+
+private:
+    quint64 m_lanes[4];
+    quint64 m_length;
+    uchar m_pending[32]; //Input that doesn't fill a stripe yet
+    int m_pendingSize;
+};
+
+#endif
@@ -0,0 +1,315 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadstreams.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#include "backends/devicelink.h"
+#include "core_debug.h"
+
+const qint64 PayloadStreams::s_window;
+const qint64 PayloadStreams::s_chunkSize;
+const qint64 PayloadStreams::s_maxStreamedSize;
+const quint32 PayloadStreams::s_peerStreamFlag;
+
+PayloadStreams::PayloadStreams(DeviceLink* link)
+    : QObject(link)
+    , m_link(link)
+    , m_lastId(0)
+{
+}
+
+PayloadStreams::~PayloadStreams()
+{
+    for (const OutgoingStream& stream : qAsConst(m_outgoing)) {
+        stream.source->close();
+    }
+    for (PayloadStreamDevice* device : qAsConst(m_incoming)) {
+        if (device) {
+            device->m_streams = nullptr;
+            device->finish(QStringLiteral("Connection closed"));
+        }
+    }
+}
+
+quint32 PayloadStreams::send(const QSharedPointer<QIODevice>& source, qint64 size)
+{
+    if (size < 0 || size > s_maxStreamedSize) {
+        return 0;
+    }
+    if (!source->isOpen() && !source->open(QIODevice::ReadOnly)) {
+        qCWarning(KDECONNECT_CORE) << "error when opening the input to upload";
+        return 0;
+    }
+
+    m_lastId = (m_lastId + 1) & ~s_peerStreamFlag;
+    if (m_lastId == 0) {
+        m_lastId = 1;
+    }
+    m_outgoing.insert(m_lastId, {source, size, s_window});
+    connect(source.data(), &QIODevice::readyRead, this, &PayloadStreams::sendData, Qt::UniqueConnection);
+
+    //The caller still has to queue the packet announcing the stream
+    QMetaObject::invokeMethod(this, "sendData", Qt::QueuedConnection);
+    return m_lastId;
+}
+
+void PayloadStreams::cancel(quint32 id)
+{
+    const auto it = m_outgoing.find(id);
+    if (it != m_outgoing.end()) {
+        it->source->close();
+        m_outgoing.erase(it);
+    }
+}
+
+QSharedPointer<QIODevice> PayloadStreams::receive(quint32 id, qint64 size)
+{
+    PayloadStreamDevice* device = new PayloadStreamDevice(this, id, size);
+    m_incoming.insert(id, device);
+    return QSharedPointer<QIODevice>(device);
+}
+
+bool PayloadStreams::isStreamFrame(const QByteArray& frame)
+{
+    return !frame.isEmpty() && frame.at(0) >= NetworkPacket::s_streamDataMarker && frame.at(0) <= NetworkPacket::s_streamCloseMarker;
+}
+
+void PayloadStreams::frameReceived(const QByteArray& frame)
+{
+    const int headerSize = NetworkPacket::s_frameHeaderSize + 4;
+    if (frame.size() < headerSize || NetworkPacket::binaryFrameSize(frame.constData(), frame.size()) != frame.size()) {
+        qCWarning(KDECONNECT_CORE) << "Ignoring malformed stream frame";
+        return;
+    }
+
+    const char marker = frame.at(0);
+    const quint32 rawId = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(frame.constData() + NetworkPacket::s_frameHeaderSize));
+    const quint32 id = rawId & ~s_peerStreamFlag;
+
+    if (rawId & s_peerStreamFlag) {
+        //About a stream we are sending
+        const auto it = m_outgoing.find(id);
+        if (it == m_outgoing.end()) {
+            return;
+        }
+        if (marker == NetworkPacket::s_streamWindowMarker && frame.size() >= headerSize + 4) {
+            it->window += qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(frame.constData() + headerSize));
+            sendData();
+        } else if (marker == NetworkPacket::s_streamCloseMarker) {
+            //The receiver doesn't want the rest
+            it->source->close();
+            m_outgoing.erase(it);
+        }
+        return;
+    }
+
+    PayloadStreamDevice* device = m_incoming.value(id);
+    if (!device) {
+        //Cancelled by us, the sender will stop soon
+        return;
+    }
+    if (marker == NetworkPacket::s_streamDataMarker) {
+        //A sender that doesn't respect the limits would have us buffer without end
+        if (!device->append(frame.constData() + headerSize, frame.size() - headerSize)) {
+            closed(id);
+            device->finish(QStringLiteral("The sender sent more than it was allowed to"));
+        }
+    } else if (marker == NetworkPacket::s_streamCloseMarker) {
+        m_incoming.remove(id);
+        device->finish();
+    }
+}
+
+void PayloadStreams::reset()
+{
+    //Whatever we had sent of the streams may be lost with the old connection. Ending them
+    //lets the peer notice the payloads are incomplete, instead of waiting for them forever.
+    for (auto it = m_outgoing.begin(); it != m_outgoing.end(); ++it) {
+        it->source->close();
+        Q_EMIT frameReady(createFrame(NetworkPacket::s_streamCloseMarker, it.key()), true);
+    }
+    m_outgoing.clear();
+
+    const auto incoming = m_incoming;
+    m_incoming.clear();
+    for (PayloadStreamDevice* device : incoming) {
+        if (device) {
+            device->finish(QStringLiteral("Connection reset"));
+        }
+    }
+}
+
+void PayloadStreams::sendData()
+{
+    auto it = m_outgoing.begin();
+    while (it != m_outgoing.end()) {
+        OutgoingStream& stream = it.value();
+        while (stream.window > 0 && stream.remaining > 0) {
+            //Don't fill the queues of the link with payloads, packets have to fit there too
+            if (m_link->queuedBytes() >= DeviceLink::s_maxQueuedBytes / 2) {
+                return;
+            }
+            const qint64 size = qMin(s_chunkSize, qMin(stream.window, stream.remaining));
+            const QByteArray data = stream.source->read(size);
+            if (data.isEmpty()) {
+                //Sequential sources may just not have the next chunk yet
+                if (!stream.source->isOpen() || (!stream.source->isSequential() && stream.source->atEnd())) {
+                    qCWarning(KDECONNECT_CORE) << "Payload ended" << stream.remaining << "bytes before its announced size";
+                    stream.remaining = 0;
+                }
+                break; //Otherwise we continue on readyRead
+            }
+            Q_EMIT frameReady(createFrame(NetworkPacket::s_streamDataMarker, it.key(), data.constData(), data.size()), true);
+            stream.window -= data.size();
+            stream.remaining -= data.size();
+        }
+
+        if (stream.remaining == 0) {
+            Q_EMIT frameReady(createFrame(NetworkPacket::s_streamCloseMarker, it.key()), true);
+            stream.source->close();
+            it = m_outgoing.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void PayloadStreams::consumed(quint32 id, qint64 bytes)
+{
+    char credit[4];
+    qToBigEndian<quint32>(quint32(bytes), reinterpret_cast<uchar*>(credit));
+    Q_EMIT frameReady(createFrame(NetworkPacket::s_streamWindowMarker, id | s_peerStreamFlag, credit, sizeof(credit)), false);
+}
+
+void PayloadStreams::closed(quint32 id)
+{
+    if (m_incoming.remove(id)) {
+        Q_EMIT frameReady(createFrame(NetworkPacket::s_streamCloseMarker, id | s_peerStreamFlag), false);
+    }
+}
+
+QByteArray PayloadStreams::createFrame(char marker, quint32 id, const char* data, int size)
+{
+    QByteArray frame(NetworkPacket::s_frameHeaderSize + 4 + size, Qt::Uninitialized);
+    uchar* header = reinterpret_cast<uchar*>(frame.data());
+    header[0] = uchar(marker);
+    qToBigEndian<quint32>(quint32(4 + size), header + 1);
+    qToBigEndian<quint32>(id, header + NetworkPacket::s_frameHeaderSize);
+    if (size > 0) {
+        std::memcpy(frame.data() + NetworkPacket::s_frameHeaderSize + 4, data, size);
+    }
+    return frame;
+}
+
+PayloadStreamDevice::PayloadStreamDevice(PayloadStreams* streams, quint32 id, qint64 size)
+    : m_streams(streams)
+    , m_id(id)
+    , m_size(size)
+    , m_received(0)
+    , m_unacknowledged(0)
+    , m_credit(PayloadStreams::s_window)
+    , m_offset(0)
+    , m_finished(false)
+{
+    open(QIODevice::ReadOnly);
+}
+
+PayloadStreamDevice::~PayloadStreamDevice()
+{
+    if (!m_finished && m_streams) {
+        m_streams->closed(m_id);
+    }
+}
+
+void PayloadStreamDevice::close()
+{
+    if (!m_finished) {
+        m_finished = true;
+        if (m_streams) {
+            m_streams->closed(m_id);
+        }
+    }
+    QIODevice::close();
+}
+
+qint64 PayloadStreamDevice::readData(char* data, qint64 maxSize)
+{
+    const qint64 size = qMin<qint64>(maxSize, m_buffer.size() - m_offset);
+    if (size <= 0) {
+        return m_finished? -1 : 0;
+    }
+
+    std::memcpy(data, m_buffer.constData() + m_offset, size);
+    m_offset += int(size);
+    if (m_offset == m_buffer.size()) {
+        m_buffer.resize(0);
+        m_offset = 0;
+    }
+
+    //Credit is given back in batches, one window frame per read would be too many
+    m_unacknowledged += size;
+    if (!m_finished && m_streams && m_unacknowledged >= PayloadStreams::s_window / 4) {
+        m_streams->consumed(m_id, m_unacknowledged);
+        m_credit += m_unacknowledged;
+        m_unacknowledged = 0;
+    }
+    return size;
+}
+
+qint64 PayloadStreamDevice::writeData(const char* data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+bool PayloadStreamDevice::append(const char* data, int size)
+{
+    if (m_received + size > m_credit || (m_size >= 0 && m_received + size > m_size)) {
+        qCWarning(KDECONNECT_CORE) << "Stream" << m_id << "got" << m_received + size << "bytes, but the window allows"
+                                   << m_credit << "and the payload has" << m_size << ", cancelling it";
+        return false;
+    }
+
+    if (m_offset > 0 && m_offset >= m_buffer.size() / 2) {
+        m_buffer.remove(0, m_offset);
+        m_offset = 0;
+    }
+    m_buffer.append(data, size);
+    m_received += size;
+    Q_EMIT readyRead();
+    return true;
+}
+
+void PayloadStreamDevice::finish(const QString& error)
+{
+    m_finished = true;
+    if (!error.isEmpty()) {
+        setErrorString(error);
+    } else if (m_size >= 0 && m_received != m_size) {
+        qCWarning(KDECONNECT_CORE) << "Received" << m_received << "bytes of a payload of" << m_size;
+        setErrorString(QStringLiteral("Incomplete payload"));
+    }
+    Q_EMIT readChannelFinished();
+}
@@ -0,0 +1,142 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADSTREAMS_H
+#define PAYLOADSTREAMS_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QMap>
+#include <QHash>
+#include <QPointer>
+#include <QSharedPointer>
+
+#include <kdeconnectcore_export.h>
+
+class DeviceLink;
+class PayloadStreamDevice;
+
+/*
+ * Carries payloads as streams of frames over the connection of a link, next to its packets,
+ * instead of opening a connection for each of them.
+ *
+ * Each frame has the header of binary packets (a marker and a big endian 32 bit length)
+ * followed by a big endian 32 bit stream id:
+ *  - data frames carry the next chunk of a stream
+ *  - window frames give the sender credit to send that many more bytes
+ *  - close frames end a stream. The sender sends one after the last chunk, the receiver
+ *    to cancel it.
+ * Ids are chosen by the sender. Frames the receiver sends about a stream have s_peerStreamFlag set.
+ */
+class KDECONNECTCORE_EXPORT PayloadStreams
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PayloadStreams(DeviceLink* link);
+    ~PayloadStreams() override;
+
+    //Starts sending source after the packets already queued in the link, returns the id
+    //to put in the payload transfer info of its packet, or 0 if it can't be streamed
+    quint32 send(const QSharedPointer<QIODevice>& source, qint64 size);
+    //Forgets an outgoing stream whose packet could not be sent
+    void cancel(quint32 id);
+
+    //The device the payload of a received packet can be read from
+    QSharedPointer<QIODevice> receive(quint32 id, qint64 size);
+
+    static bool isStreamFrame(const QByteArray& frame);
+    void frameReceived(const QByteArray& frame);
+
+    //Ends every stream, for when the connection they were using is gone
+    void reset();
+
+    //A sender has at most this many bytes in flight per stream
+    const static qint64 s_window = 256 * 1024;
+    const static qint64 s_chunkSize = 16 * 1024;
+    //Bigger payloads get a connection of their own, so they don't compete with packets for too long
+    const static qint64 s_maxStreamedSize = 4 * 1024 * 1024;
+    const static quint32 s_peerStreamFlag = 0x80000000;
+
+Q_SIGNALS:
+    //A frame to send, after the packets already queued with the same priority
+    void frameReady(const QByteArray& frame, bool bulk);
+
+public Q_SLOTS:
+    //Sends as much of the outgoing streams as their windows and the queues of the link allow
+    void sendData();
+
+private:
+    friend class PayloadStreamDevice;
+    void consumed(quint32 id, qint64 bytes);
+    void closed(quint32 id);
+
+    static QByteArray createFrame(char marker, quint32 id, const char* data = nullptr, int size = 0);
+
+    struct OutgoingStream {
+        QSharedPointer<QIODevice> source;
+        qint64 remaining;
+        qint64 window;
+    };
+
+    DeviceLink* m_link;
+    quint32 m_lastId;
+    QMap<quint32, OutgoingStream> m_outgoing; //Oldest streams are sent first
+    QHash<quint32, QPointer<PayloadStreamDevice>> m_incoming;
+};
+
+//Sequential device with the data received so far for a stream
+class PayloadStreamDevice
+    : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    PayloadStreamDevice(PayloadStreams* streams, quint32 id, qint64 size);
+    ~PayloadStreamDevice() override;
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_buffer.size() - m_offset + QIODevice::bytesAvailable(); }
+    bool atEnd() const override { return m_finished && bytesAvailable() == 0; }
+    void close() override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    friend class PayloadStreams;
+    //False if the sender went past the window we gave it or the size it announced
+    bool append(const char* data, int size);
+    void finish(const QString& error = QString());
+
+    QPointer<PayloadStreams> m_streams;
+    const quint32 m_id;
+    const qint64 m_size;
+    qint64 m_received;
+    qint64 m_unacknowledged; //Bytes read since we last gave the sender credit
+    qint64 m_credit; //Bytes the sender may have sent in total
+    QByteArray m_buffer;
+    int m_offset;
+    bool m_finished;
+};
+
+#endif
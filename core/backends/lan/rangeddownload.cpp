@@ -0,0 +1,296 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rangeddownload.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#include "lanlinkprovider.h"
+#include "uploadjob.h"
+#include "core_debug.h"
+
+const int RangedDownload::s_initialConnections;
+const int RangedDownload::s_adaptInterval;
+const qint64 RangedDownload::s_maxBufferedBytes;
+const qint64 RangedDownload::s_socketBufferSize;
+
+RangedDownload::RangedDownload(const QHostAddress& address, const QVariantMap& transferInfo, qint64 size)
+    : m_address(address)
+    , m_port(quint16(transferInfo.value(QStringLiteral("port")).toUInt()))
+    , m_token(transferInfo.value(QStringLiteral("token")).toString().toLatin1())
+    , m_deviceId(transferInfo.value(QStringLiteral("deviceId")).toString())
+    , m_maxConnections(qBound(1, transferInfo.value(QStringLiteral("rangeConnections")).toInt(), UploadJob::s_maxRangeConnections))
+    , m_size(size)
+    , m_nextBlock(0)
+    , m_buffered(0)
+    , m_readyOffset(0)
+    , m_received(0)
+    , m_receivedAtLastCheck(0)
+    , m_bestRate(0)
+    , m_finished(false)
+    , m_readQueued(false)
+{
+    m_adaptTimer.setInterval(s_adaptInterval);
+    connect(&m_adaptTimer, &QTimer::timeout, this, &RangedDownload::adaptConnections);
+
+    open(QIODevice::ReadOnly);
+}
+
+RangedDownload::~RangedDownload()
+{
+    qDeleteAll(m_connections.keys());
+}
+
+void RangedDownload::start()
+{
+    if (m_finished || !m_connections.isEmpty()) {
+        return;
+    }
+    if (m_size <= 0) {
+        finish();
+        return;
+    }
+
+    for (int i = 0; i < qMin(s_initialConnections, m_maxConnections); ++i) {
+        openConnection();
+    }
+    m_adaptTimer.start();
+}
+
+void RangedDownload::openConnection()
+{
+    if (m_finished || m_connections.size() >= m_maxConnections) {
+        return;
+    }
+
+    QSslSocket* socket = new QSslSocket(this);
+    socket->setReadBufferSize(s_socketBufferSize);
+    LanLinkProvider::configureSslSocket(socket, m_deviceId, true);
+    m_connections.insert(socket, {0, 0});
+
+    connect(socket, &QAbstractSocket::connected, this, &RangedDownload::connectionEstablished);
+    connect(socket, &QIODevice::readyRead, this, &RangedDownload::dataReceived);
+    connect(socket, &QAbstractSocket::disconnected, this, &RangedDownload::connectionClosed);
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(connectionClosed()));
+
+    socket->connectToHost(m_address, m_port, QIODevice::ReadWrite);
+}
+
+void RangedDownload::connectionEstablished()
+{
+    //Same as DownloadJob: the uploader finds the payload from the token and encrypts as the TLS client
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    socket->write(m_token + '\n');
+    socket->startServerEncryption();
+}
+
+void RangedDownload::dataReceived()
+{
+    readFrom(qobject_cast<QSslSocket*>(sender()));
+    deliverBlocks();
+}
+
+void RangedDownload::readConnections()
+{
+    m_readQueued = false;
+    const QList<QSslSocket*> sockets = m_connections.keys();
+    for (QSslSocket* socket : sockets) {
+        readFrom(socket);
+    }
+    deliverBlocks();
+    checkConnections();
+}
+
+void RangedDownload::readFrom(QSslSocket* socket)
+{
+    while (!m_finished && m_connections.contains(socket)) {
+        Connection& connection = m_connections[socket];
+        if (connection.blockRemaining == 0) {
+            if (socket->bytesAvailable() < UploadJob::s_rangeHeaderSize) {
+                return;
+            }
+            uchar header[UploadJob::s_rangeHeaderSize];
+            socket->read(reinterpret_cast<char*>(header), sizeof(header));
+            const qint64 offset = qint64(qFromBigEndian<quint64>(header));
+            const qint64 length = qFromBigEndian<quint32>(header + 8);
+            if (length <= 0 || length > UploadJob::s_rangeBlockSize || offset < m_nextBlock || offset > m_size - length || m_blocks.contains(offset)) {
+                finish(QStringLiteral("Received an invalid block"));
+                return;
+            }
+            connection.blockOffset = offset;
+            connection.blockRemaining = length;
+            m_blocks.insert(offset, {QByteArray(), length, 0});
+        }
+
+        //The block the reader needs next is only limited by the reader itself
+        const bool needed = (connection.blockOffset == m_nextBlock);
+        if (needed? bytesAvailable() >= s_maxBufferedBytes : m_buffered >= s_maxBufferedBytes) {
+            return;
+        }
+
+        const QByteArray data = socket->read(qMin(connection.blockRemaining, socket->bytesAvailable()));
+        if (data.isEmpty()) {
+            return;
+        }
+        m_blocks[connection.blockOffset].data += data;
+        connection.blockRemaining -= data.size();
+        m_buffered += data.size();
+        m_received += data.size();
+    }
+}
+
+void RangedDownload::deliverBlocks()
+{
+    qint64 delivered = 0;
+    auto it = m_blocks.find(m_nextBlock);
+    while (it != m_blocks.end()) {
+        Block& block = it.value();
+        if (!block.data.isEmpty()) {
+            if (m_readyOffset > 0) {
+                m_ready.remove(0, m_readyOffset);
+                m_readyOffset = 0;
+            }
+            m_ready += block.data;
+            delivered += block.data.size();
+            m_buffered -= block.data.size();
+            block.consumed += block.data.size();
+            block.data.clear();
+        }
+        if (block.consumed < block.length) {
+            break;
+        }
+        m_nextBlock += block.length;
+        m_blocks.erase(it);
+        it = m_blocks.find(m_nextBlock);
+    }
+
+    if (delivered > 0) {
+        Q_EMIT readyRead();
+    }
+    if (m_nextBlock == m_size) {
+        finish();
+    }
+}
+
+void RangedDownload::connectionClosed()
+{
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    if (m_connections.contains(socket)) {
+        readFrom(socket);
+        deliverBlocks();
+    }
+    checkConnections();
+}
+
+void RangedDownload::checkConnections()
+{
+    if (m_finished) {
+        return;
+    }
+
+    for (auto it = m_connections.begin(); it != m_connections.end();) {
+        QSslSocket* socket = it.key();
+        //Closed sockets are kept until we read what they have
+        if (socket->state() != QAbstractSocket::UnconnectedState || socket->bytesAvailable() > 0) {
+            ++it;
+            continue;
+        }
+        if (it->blockRemaining > 0) {
+            finish(QStringLiteral("Connection closed in the middle of a block"));
+            return;
+        }
+        socket->deleteLater();
+        it = m_connections.erase(it);
+    }
+
+    if (m_connections.isEmpty()) {
+        finish(QStringLiteral("Connection closed before the payload was received"));
+    }
+}
+
+void RangedDownload::adaptConnections()
+{
+    const qint64 rate = m_received - m_receivedAtLastCheck;
+    m_receivedAtLastCheck = m_received;
+    if (rate == 0) {
+        return; //Still connecting, or waiting for the reader
+    }
+
+    if (m_connections.size() < m_maxConnections && rate > m_bestRate + m_bestRate / 10) {
+        m_bestRate = rate;
+        openConnection();
+    } else {
+        //The last connection didn't help, this is as fast as it gets
+        m_adaptTimer.stop();
+    }
+}
+
+qint64 RangedDownload::readData(char* data, qint64 maxSize)
+{
+    const qint64 size = qMin<qint64>(maxSize, m_ready.size() - m_readyOffset);
+    if (size <= 0) {
+        return m_finished? -1 : 0;
+    }
+
+    std::memcpy(data, m_ready.constData() + m_readyOffset, size);
+    m_readyOffset += int(size);
+    if (m_readyOffset == m_ready.size()) {
+        m_ready.resize(0);
+        m_readyOffset = 0;
+    }
+
+    //There is room again for the connections we stopped reading, but not from inside a read
+    if (!m_readQueued && !m_finished) {
+        m_readQueued = true;
+        QMetaObject::invokeMethod(this, "readConnections", Qt::QueuedConnection);
+    }
+    return size;
+}
+
+qint64 RangedDownload::writeData(const char* data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+void RangedDownload::finish(const QString& error)
+{
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    m_adaptTimer.stop();
+
+    for (QSslSocket* socket : m_connections.keys()) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_connections.clear();
+
+    if (!error.isEmpty()) {
+        qCWarning(KDECONNECT_CORE) << "Ranged download failed:" << error;
+        setErrorString(error);
+    }
+    Q_EMIT readChannelFinished();
+}
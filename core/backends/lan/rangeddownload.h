@@ -0,0 +1,119 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANGEDDOWNLOAD_H
+#define RANGEDDOWNLOAD_H
+
+#include <QIODevice>
+#include <QHash>
+#include <QHostAddress>
+#include <QMap>
+#include <QSslSocket>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <kdeconnectcore_export.h>
+#include "core/transferscheduler.h"
+
+/*
+ * Downloads a payload that the sender splits in blocks over several connections (see
+ * UploadJob::setTransferToken), and reads like a single sequential stream.
+ *
+ * Blocks are put back in order in memory. Connections ahead of the one we need next stop
+ * being read when s_maxBufferedBytes are waiting, so TCP slows them down.
+ *
+ * We start with two connections and open another one every s_adaptInterval while that makes
+ * the transfer faster, up to the number the sender offered.
+ */
+class KDECONNECTCORE_EXPORT RangedDownload
+    : public ScheduledPayload
+{
+    Q_OBJECT
+
+public:
+    RangedDownload(const QHostAddress& address, const QVariantMap& transferInfo, qint64 size);
+    ~RangedDownload() override;
+
+    //Opens the first connections, only the first time it's called
+    void start() override;
+    int connectionCount() const { return m_connections.size(); }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_ready.size() - m_readyOffset + QIODevice::bytesAvailable(); }
+    bool atEnd() const override { return m_finished && bytesAvailable() == 0; }
+
+    const static int s_initialConnections = 2;
+    const static int s_adaptInterval = 1000;
+    const static qint64 s_maxBufferedBytes = 16 * 1024 * 1024;
+    //Sockets we don't read from stop taking data from the network at this size
+    const static qint64 s_socketBufferSize = 2 * 1024 * 1024;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private Q_SLOTS:
+    void openConnection();
+    void connectionEstablished();
+    void dataReceived();
+    void connectionClosed();
+    void adaptConnections();
+    void readConnections();
+
+private:
+    struct Connection {
+        qint64 blockOffset;
+        qint64 blockRemaining; //Bytes of the current block still to be read from the socket
+    };
+    struct Block {
+        QByteArray data; //Received and not handed to the reader yet
+        qint64 length;
+        qint64 consumed; //Handed to the reader
+    };
+
+    void readFrom(QSslSocket* socket);
+    void deliverBlocks();
+    void checkConnections();
+    void finish(const QString& error = QString());
+
+    const QHostAddress m_address;
+    const quint16 m_port;
+    const QByteArray m_token;
+    const QString m_deviceId;
+    const int m_maxConnections;
+    const qint64 m_size;
+
+    QHash<QSslSocket*, Connection> m_connections;
+    QMap<qint64, Block> m_blocks;
+    qint64 m_nextBlock; //Offset of the block the reader gets data from
+    qint64 m_buffered; //Bytes in m_blocks
+
+    QByteArray m_ready;
+    int m_readyOffset;
+
+    QTimer m_adaptTimer;
+    qint64 m_received;
+    qint64 m_receivedAtLastCheck;
+    qint64 m_bestRate;
+    bool m_finished;
+    bool m_readQueued;
+};
+
+#endif
@@ -21,28 +21,66 @@
 
 #include "socketlinereader.h"
 
+#include "core_debug.h"
+#include "core/networkpacket.h"
+
+#include <cstring>
+
 SocketLineReader::SocketLineReader(QSslSocket* socket, QObject* parent)
     : QObject(parent)
     , m_socket(socket)
+    , m_frameStart(0)
+    , m_scanned(0)
 {
     connect(m_socket, &QIODevice::readyRead,
             this, &SocketLineReader::dataReceived);
 }
 
+QByteArray SocketLineReader::readLine()
+{
+    const QPair<int, int> packet = m_packets.dequeue();
+    return QByteArray(m_buffer.constData() + packet.first, packet.second);
+}
+
+QByteArray SocketLineReader::readLineView()
+{
+    const QPair<int, int> packet = m_packets.dequeue();
+    return QByteArray::fromRawData(m_buffer.constData() + packet.first, packet.second);
+}
+
 void SocketLineReader::dataReceived()
 {
-    while (m_socket->canReadLine()) {
-        const QByteArray line = m_socket->readLine();
-        if (line.length() > 1) { //we don't want a single \n
-            m_packets.enqueue(line);
+    //Drop what was already read. Packets that were not read yet are moved to the front
+    //with the rest, which is usually the beginning of a line we don't have whole yet.
+    const int consumed = m_packets.isEmpty()? m_frameStart : m_packets.head().first;
+    if (consumed == m_buffer.size()) {
+        m_buffer.resize(0); //Keeps the allocation
+        m_frameStart = m_scanned = 0;
+        m_packets.clear();
+    } else if (consumed > 0 && consumed >= m_buffer.size() / 2) {
+        std::memmove(m_buffer.data(), m_buffer.constData() + consumed, m_buffer.size() - consumed);
+        m_buffer.resize(m_buffer.size() - consumed);
+        m_frameStart -= consumed;
+        m_scanned -= consumed;
+        for (QPair<int, int>& packet : m_packets) {
+            packet.first -= consumed;
         }
     }
 
-    //If we still have things to read from the socket, call dataReceived again
-    //We do this manually because we do not trust readyRead to be emitted again
-    //So we call this method again just in case.
-    if (m_socket->bytesAvailable() > 0) {
-        QMetaObject::invokeMethod(this, "dataReceived", Qt::QueuedConnection);
+    const qint64 available = m_socket->bytesAvailable();
+    if (available > 0) {
+        const int oldSize = m_buffer.size();
+        m_buffer.resize(oldSize + int(available));
+        const qint64 read = m_socket->read(m_buffer.data() + oldSize, available);
+        m_buffer.resize(oldSize + int(qMax<qint64>(read, 0)));
+    }
+
+    if (!splitPackets()) {
+        qCWarning(KDECONNECT_CORE) << "Packet from" << m_socket->peerAddress() << "is bigger than" << s_maxLineLength << "bytes, disconnecting";
+        m_packets.clear();
+        m_buffer.clear();
+        m_frameStart = m_scanned = 0;
+        m_socket->abort();
         return;
     }
 
@@ -51,3 +89,41 @@ void SocketLineReader::dataReceived()
         Q_EMIT readyRead();
     }
 }
+
+bool SocketLineReader::splitPackets()
+{
+    const char* data = m_buffer.constData();
+    const int size = m_buffer.size();
+
+    while (m_frameStart < size) {
+        if (NetworkPacket::isFrameMarker(data[m_frameStart])) {
+            const qint64 frameSize = NetworkPacket::binaryFrameSize(data + m_frameStart, size - m_frameStart);
+            if (frameSize > s_maxLineLength) {
+                return false;
+            }
+            if (frameSize < 0 || size - m_frameStart < frameSize) {
+                break;
+            }
+            m_packets.enqueue(qMakePair(m_frameStart, int(frameSize)));
+            m_frameStart += int(frameSize);
+            m_scanned = m_frameStart;
+        } else {
+            //Lines are scanned only once, even if they arrive in many chunks
+            const int from = qMax(m_scanned, m_frameStart);
+            const char* newline = static_cast<const char*>(std::memchr(data + from, '\n', size - from));
+            if (!newline) {
+                m_scanned = size;
+                if (size - m_frameStart > s_maxLineLength) {
+                    return false;
+                }
+                break;
+            }
+            const int lineEnd = int(newline - data) + 1;
+            if (lineEnd - m_frameStart > 1) { //we don't want a single \n
+                m_packets.enqueue(qMakePair(m_frameStart, lineEnd - m_frameStart));
+            }
+            m_frameStart = m_scanned = lineEnd;
+        }
+    }
+    return true;
+}
@@ -23,6 +23,7 @@
 
 #include <QObject>
 #include <QQueue>
+#include <QPair>
 #include <QSslSocket>
 #include <QHostAddress>
 
@@ -30,7 +31,11 @@
 
 /*
  * Encapsulates a QTcpSocket and implements the same methods of its API that are
- * used by LanDeviceLink, but readyRead is emitted only when a newline is found.
+ * used by LanDeviceLink, but readyRead is emitted only when a newline is found
+ * (or a whole binary frame, for links using a binary wire format).
+ *
+ * Everything the socket has is read into a single buffer and split there, so
+ * every complete packet is available by the time readyRead is emitted.
  */
 class KDECONNECTCORE_EXPORT SocketLineReader
     : public QObject
@@ -40,14 +45,19 @@ class KDECONNECTCORE_EXPORT SocketLineReader
 public:
     explicit SocketLineReader(QSslSocket* socket, QObject* parent = nullptr);
 
-    QByteArray readLine() { return m_packets.dequeue(); }
+    QByteArray readLine();
+    //Same as readLine, but without copying. The data is only valid until we go back to the event loop
+    QByteArray readLineView();
     qint64 write(const QByteArray& data) { return m_socket->write(data); }
     QHostAddress peerAddress() const { return m_socket->peerAddress(); }
     QSslCertificate peerCertificate() const { return m_socket->peerCertificate(); }
     qint64 bytesAvailable() const { return m_packets.size(); }
 
     QSslSocket* m_socket;
-    
+
+    //Peers sending lines longer than this get disconnected, instead of making us buffer them forever
+    const static int s_maxLineLength = 32 * 1024 * 1024;
+
 Q_SIGNALS:
     void readyRead();
 
@@ -55,8 +65,12 @@ private Q_SLOTS:
     void dataReceived();
 
 private:
-    QByteArray m_lastChunk;
-    QQueue<QByteArray> m_packets;
+    bool splitPackets();
+
+    QByteArray m_buffer;
+    int m_frameStart; //Offset of the first byte in m_buffer not belonging to a complete packet
+    int m_scanned; //Offset up to which we know there is no '\n' after m_frameStart
+    QQueue<QPair<int, int>> m_packets; //Offset and size in m_buffer of each complete packet
 
 };
 
@@ -22,24 +22,55 @@
 
 #include <KLocalizedString>
 
+#include <QFile>
+#include <QtEndian>
+
 #include "lanlinkprovider.h"
 #include "kdeconnectconfig.h"
+#include "networkpacket.h"
 #include "core_debug.h"
 
+const qint64 UploadJob::s_minChunkSize;
+const qint64 UploadJob::s_maxChunkSize;
+const qint64 UploadJob::s_minRangedSize;
+const int UploadJob::s_maxRangeConnections;
+const qint64 UploadJob::s_rangeBlockSize;
+const int UploadJob::s_resumeTimeout;
+
 UploadJob::UploadJob(const QSharedPointer<QIODevice>& source, const QString& deviceId)
     : KJob()
     , m_input(source)
-    , m_server(new Server(this))
+    , m_server(nullptr)
     , m_socket(nullptr)
     , m_port(0)
     , m_deviceId(deviceId) // We will use this info if link is on ssl, to send encrypted payload
+    , m_chunkSize(s_minChunkSize)
+    , m_mapped(nullptr)
+    , m_mappedSize(0)
+    , m_mappedOffset(0)
+    , m_sent(0)
+    , m_closing(false)
+    , m_checksumTrailer(false)
+    , m_rangeConnections(1)
+    , m_rangeCursor(0)
+    , m_inputSize(0)
 {
     connect(m_input.data(), &QIODevice::readyRead, this, &UploadJob::startUploading);
     connect(m_input.data(), &QIODevice::aboutToClose, this, &UploadJob::aboutToClose);
+
+    m_resumeTimer.setSingleShot(true);
+    m_resumeTimer.setInterval(s_resumeTimeout);
+    connect(&m_resumeTimer, &QTimer::timeout, this, &UploadJob::resumeTimedOut);
 }
 
 void UploadJob::start()
 {
+    if (!m_token.isEmpty()) {
+        //LanLinkProvider gives us the connection
+        return;
+    }
+
+    m_server = new Server(this);
     m_port = MIN_PORT;
     while (!m_server->listen(QHostAddress::Any, m_port)) {
         m_port++;
@@ -55,69 +86,393 @@ void UploadJob::start()
     connect(m_server, &QTcpServer::newConnection, this, &UploadJob::newConnection);
 }
 
+void UploadJob::setChecksumTrailer(bool enabled)
+{
+    m_checksumTrailer = enabled && m_rangeConnections <= 1;
+}
+
+void UploadJob::setTransferToken(quint16 port, const QString& token, int rangeConnections)
+{
+    m_port = port;
+    m_token = token;
+    m_rangeConnections = rangeConnections;
+}
+
 void UploadJob::newConnection()
 {
+    Server* server = qobject_cast<Server*>(sender());
+    // FIXME : It is called again when payload sending is finished. Unsolved mystery :(
+    disconnect(m_server, &QTcpServer::newConnection, this, &UploadJob::newConnection);
+
+    if (setSocket(server->nextPendingConnection())) {
+        m_socket->startServerEncryption();
+    }
+}
+
+void UploadJob::connectionReceived(QSslSocket* socket, qint64 offset, const QByteArray& checksum)
+{
+    if (m_rangeConnections > 1) {
+        addRangeSocket(socket);
+        return;
+    }
+
+    //The checksum at the end covers the whole payload, peers resuming it don't expect it
+    if (!checksum.isEmpty()) {
+        m_checksumTrailer = false;
+    }
+
+    //Once we sent something, a new request continues from where the peer says, even if that's the beginning
+    if ((offset != 0 || m_sent > 0) && !seekTo(offset, checksum)) {
+        qCWarning(KDECONNECT_CORE) << "Can't resume the upload at" << offset << "for" << socket->peerAddress();
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+    m_resumeTimer.stop();
+
+    if (m_socket) {
+        //Only the peer has the token, so it lost the old connection even if we didn't notice yet
+        //(eg: it moved to another network and TCP keeps retransmitting to the old address)
+        qCDebug(KDECONNECT_CORE) << "Payload requested again from" << socket->peerAddress() << "dropping the old connection";
+        m_socket->disconnect(this);
+        m_socket->abort();
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+
+    if (setSocket(socket)) {
+        m_socket->startClientEncryption();
+    }
+}
+
+bool UploadJob::canResume() const
+{
+    return !m_token.isEmpty() && m_rangeConnections <= 1 && !m_input->isSequential();
+}
+
+bool UploadJob::seekTo(qint64 offset, const QByteArray& checksum)
+{
+    if (!canResume() || !openInput() || offset < 0 || offset > m_inputSize) {
+        return false;
+    }
+
+    //The peer has to have the same bytes we'd have sent, or the file changed since
+    const qint64 checked = qMin(offset, NetworkPacket::s_resumeCheckSize);
+    if (offset > 0 && NetworkPacket::payloadResumeChecksum(readAt(offset - checked, checked)) != checksum) {
+        return false;
+    }
+
+    if (m_mapped) {
+        m_mappedOffset = offset;
+    } else if (!m_input->seek(offset)) {
+        return false;
+    }
+    qCDebug(KDECONNECT_CORE) << "Resuming upload at" << offset << "of" << m_inputSize;
+    return true;
+}
+
+void UploadJob::waitForResume()
+{
+    qCDebug(KDECONNECT_CORE) << "Upload interrupted after" << m_sent << "bytes, waiting for the peer to resume it";
+    m_socket->disconnect(this);
+    m_socket->deleteLater();
+    m_socket = nullptr;
+    m_resumeTimer.start();
+}
+
+void UploadJob::resumeTimedOut()
+{
+    //If we had sent everything the peer probably got it all and just closed first
+    if (m_input->isOpen()) {
+        m_input->close();
+        setError(2);
+        setErrorText(i18n("Connection closed before the file was sent"));
+    }
+    emitResult();
+}
+
+bool UploadJob::openInput()
+{
+    if (m_input->isOpen()) {
+        return true;
+    }
+
     if (!m_input->open(QIODevice::ReadOnly)) {
         qCWarning(KDECONNECT_CORE) << "error when opening the input to upload";
-        return; //TODO: Handle error, clean up...
+        return false;
     }
+    m_inputSize = m_input->size();
 
-    Server* server = qobject_cast<Server*>(sender());
-    // FIXME : It is called again when payload sending is finished. Unsolved mystery :(
-    disconnect(m_server, &QTcpServer::newConnection, this, &UploadJob::newConnection);
+    //Falls back to reading the file if it can't be mapped (eg: it is empty or not a regular file)
+    QFile* file = qobject_cast<QFile*>(m_input.data());
+    if (file && file->size() > 0) {
+        m_mapped = file->map(0, file->size());
+        m_mappedSize = m_mapped? file->size() : 0;
+    }
+    return true;
+}
 
-    m_socket = server->nextPendingConnection();
+bool UploadJob::setSocket(QSslSocket* socket)
+{
+    m_socket = socket;
+    m_closing = false;
     m_socket->setParent(this);
+
+    if (!openInput()) {
+        m_socket->close();
+        return false; //TODO: Handle error, clean up...
+    }
+
     connect(m_socket, &QSslSocket::disconnected, this, &UploadJob::cleanup);
     connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketFailed(QAbstractSocket::SocketError)));
     connect(m_socket, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrors(QList<QSslError>)));
     connect(m_socket, &QSslSocket::encrypted, this, &UploadJob::startUploading);
+    connect(m_socket, &QIODevice::bytesWritten, this, &UploadJob::startUploading);
 //     connect(mSocket, &QAbstractSocket::stateChanged, [](QAbstractSocket::SocketState state){ qDebug() << "statechange" << state; });
 
     LanLinkProvider::configureSslSocket(m_socket, m_deviceId, true);
-
-    m_socket->startServerEncryption();
+    Q_EMIT peerConnected();
+    return true;
 }
 
 void UploadJob::startUploading()
 {
-    while ( m_input->bytesAvailable() > 0 )
-    {
-        qint64 bytes = qMin(m_input->bytesAvailable(), (qint64)4096);
-        int w = m_socket->write(m_input->read(bytes));
-        if (w<0) {
-            qCWarning(KDECONNECT_CORE) << "error when writing data to upload" << bytes << m_input->bytesAvailable();
-            break;
+    //Called again every time the socket writes something, so we never wait for it here
+    if (!m_socket || !m_socket->isEncrypted() || !m_input->isOpen()) {
+        return;
+    }
+    if (!m_timer.isValid()) {
+        m_timer.start();
+    }
+
+    qint64 pending = m_socket->bytesToWrite() + m_socket->encryptedBytesToWrite();
+    if (pending == 0 && m_chunkSize < s_maxChunkSize) {
+        //The socket sent everything we gave it, bigger chunks mean fewer wakeups
+        m_chunkSize *= 2;
+    }
+
+    while (inputAvailable() > 0 && pending < s_chunksInFlight * m_chunkSize) {
+        const QByteArray chunk = readChunk(qMin(inputAvailable(), m_chunkSize));
+        if (m_socket->write(chunk) != chunk.size()) {
+            qCWarning(KDECONNECT_CORE) << "error when writing data to upload" << chunk.size() << inputAvailable();
+            m_input->close();
+            return;
+        }
+        if (m_checksumTrailer) {
+            m_checksum.addData(chunk);
         }
-        else
-        {
-            while ( m_socket->flush() );
+        pending += chunk.size();
+        m_sent += chunk.size();
+    }
+
+    //The socket sends what it still has before disconnecting
+    if (inputAtEnd()) {
+        if (m_checksumTrailer) {
+            char trailer[PayloadChecksum::s_trailerSize];
+            qToBigEndian<quint64>(m_checksum.result(), reinterpret_cast<uchar*>(trailer));
+            m_socket->write(trailer, sizeof(trailer));
         }
+        m_input->close();
     }
-    m_input->close();
+}
+
+void UploadJob::addRangeSocket(QSslSocket* socket)
+{
+    socket->setParent(this);
+    if (m_input->isSequential() || !openInput()) {
+        qCWarning(KDECONNECT_CORE) << "Can't send blocks of this input";
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+
+    m_rangeSockets.append(socket);
+    connect(socket, &QSslSocket::encrypted, this, &UploadJob::sendRanges);
+    connect(socket, &QIODevice::bytesWritten, this, &UploadJob::sendRanges);
+    connect(socket, &QAbstractSocket::disconnected, this, &UploadJob::rangeSocketClosed);
+
+    LanLinkProvider::configureSslSocket(socket, m_deviceId, true);
+    socket->startClientEncryption();
+    Q_EMIT peerConnected();
+}
+
+void UploadJob::sendRanges()
+{
+    if (!m_timer.isValid()) {
+        m_timer.start();
+    }
+
+    //A block waiting in each socket keeps them all busy, the next one goes to whichever sends its block first
+    const QList<QSslSocket*> sockets = m_rangeSockets;
+    for (QSslSocket* socket : sockets) {
+        if (!socket->isEncrypted()) {
+            continue;
+        }
+        while (m_rangeCursor < m_inputSize && socket->bytesToWrite() + socket->encryptedBytesToWrite() < s_rangeBlockSize) {
+            const qint64 length = qMin(s_rangeBlockSize, m_inputSize - m_rangeCursor);
+            const QByteArray block = readAt(m_rangeCursor, length);
+            if (block.size() != length) {
+                qCWarning(KDECONNECT_CORE) << "error when reading data to upload at" << m_rangeCursor;
+                socket->abort();
+                return;
+            }
+
+            char header[s_rangeHeaderSize];
+            qToBigEndian<quint64>(quint64(m_rangeCursor), reinterpret_cast<uchar*>(header));
+            qToBigEndian<quint32>(quint32(length), reinterpret_cast<uchar*>(header + 8));
+            socket->write(header, sizeof(header));
+            socket->write(block);
+            socket->setProperty("sentBlocks", true);
+
+            m_rangeCursor += length;
+            m_sent += length;
+        }
+    }
+
+    if (m_rangeCursor == m_inputSize) {
+        //Every block is in a socket, they disconnect once they have sent them
+        for (QSslSocket* socket : sockets) {
+            if (socket->isEncrypted()) {
+                socket->disconnectFromHost();
+            }
+        }
+    }
+}
+
+void UploadJob::rangeSocketClosed()
+{
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    m_rangeSockets.removeOne(socket);
+    socket->deleteLater();
+
+    if (m_rangeCursor < m_inputSize && socket->property("sentBlocks").toBool()) {
+        //The blocks that were still in it are lost
+        qCWarning(KDECONNECT_CORE) << "Payload connection closed at" << m_rangeCursor << "of" << m_inputSize;
+        for (QSslSocket* other : qAsConst(m_rangeSockets)) {
+            other->abort();
+        }
+        m_rangeSockets.clear();
+        m_input->close();
+        setError(2);
+        setErrorText(i18n("Connection closed before the file was sent"));
+        emitResult();
+        return;
+    }
+
+    if (m_rangeSockets.isEmpty() && m_rangeCursor == m_inputSize) {
+        qCDebug(KDECONNECT_CORE) << "Uploaded" << m_sent << "bytes in" << m_timer.elapsed() << "ms in blocks";
+        m_input->close();
+        emitResult();
+    }
+}
+
+bool UploadJob::mappingCovers(qint64 end)
+{
+    //Reading a mapping past the end of a file that was truncated meanwhile crashes (SIGBUS), so
+    //we check the file is still this big before every read and read it the usual way if it isn't
+    QFile* file = static_cast<QFile*>(m_input.data());
+    if (file->size() >= end) {
+        return true;
+    }
+    qCWarning(KDECONNECT_CORE) << "The file to upload shrank to" << file->size() << "bytes, reading it instead of its mapping";
+    file->unmap(m_mapped);
+    m_mapped = nullptr;
+    m_mappedSize = 0;
+    file->seek(m_mappedOffset);
+    return false;
+}
+
+QByteArray UploadJob::readAt(qint64 offset, qint64 size)
+{
+    if (m_mapped && mappingCovers(offset + size)) {
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(m_mapped + offset), int(size));
+    }
+    if (!m_input->seek(offset)) {
+        return QByteArray();
+    }
+    return m_input->read(size);
+}
+
+QByteArray UploadJob::readChunk(qint64 maxSize)
+{
+    if (!m_mapped || !mappingCovers(m_mappedOffset + maxSize)) {
+        return m_input->read(maxSize);
+    }
+    //The socket copies what we write to its own buffer, so the mapping only has to live until then
+    const QByteArray chunk = QByteArray::fromRawData(reinterpret_cast<const char*>(m_mapped + m_mappedOffset), int(maxSize));
+    m_mappedOffset += maxSize;
+    return chunk;
+}
+
+qint64 UploadJob::inputAvailable() const
+{
+    return m_mapped? m_mappedSize - m_mappedOffset : m_input->bytesAvailable();
+}
+
+bool UploadJob::inputAtEnd() const
+{
+    return m_mapped? m_mappedOffset == m_mappedSize : m_input->atEnd();
 }
 
 void UploadJob::aboutToClose()
 {
 //     qDebug() << "closing...";
-    m_socket->disconnectFromHost();
+    if (m_socket) {
+        m_closing = true;
+        m_socket->disconnectFromHost();
+    }
 }
 
 void UploadJob::cleanup()
 {
+    //Unless we closed it after sending everything, the peer may still want the rest
+    if (!m_closing && canResume()) {
+        waitForResume();
+        return;
+    }
+
+    if (m_timer.isValid()) {
+        qCDebug(KDECONNECT_CORE) << "Uploaded" << m_sent << "bytes in" << m_timer.elapsed() << "ms"
+                                 << (inputMode() == MappedInput? "from a mapped file" : "from a buffered input");
+    }
     m_socket->close();
 //     qDebug() << "closed!";
     emitResult();
 }
 
+double UploadJob::throughput() const
+{
+    if (!m_timer.isValid() || m_timer.elapsed() == 0) {
+        return -1;
+    }
+    return m_sent * 1000.0 / m_timer.elapsed();
+}
+
 QVariantMap UploadJob::transferInfo()
 {
     Q_ASSERT(m_port != 0);
-    return {{"port", m_port}};
+    if (m_rangeConnections > 1) {
+        return {{"port", m_port}, {"token", m_token}, {"rangeConnections", m_rangeConnections}};
+    }
+
+    QVariantMap info = {{"port", m_port}};
+    if (!m_token.isEmpty()) {
+        info.insert(QStringLiteral("token"), m_token);
+    }
+    if (m_checksumTrailer) {
+        info.insert(QStringLiteral("checksum"), QStringLiteral("xxh64"));
+    }
+    return info;
 }
 
 void UploadJob::socketFailed(QAbstractSocket::SocketError error)
 {
+    //Even if we were closing, the last chunks may not have arrived
+    if (canResume()) {
+        waitForResume();
+        return;
+    }
+
     qWarning() << "error uploading" << error;
     setError(2);
     emitResult();
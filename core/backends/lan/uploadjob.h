@@ -23,10 +23,13 @@
 
 #include <KJob>
 
+#include <QElapsedTimer>
 #include <QIODevice>
 #include <QVariantMap>
 #include <QSharedPointer>
 #include <QSslSocket>
+#include <QTimer>
+#include "payloadchecksum.h"
 #include "server.h"
 
 class KDECONNECTCORE_EXPORT UploadJob
@@ -38,20 +41,92 @@ public:
 
     void start() override;
 
+    //Instead of listening on a port of its own, wait for the peer to connect to port and send token.
+    //With more than one range connection, the peer may open up to that many and we send blocks
+    //of the input through whichever can take them (see RangedDownload).
+    void setTransferToken(quint16 port, const QString& token, int rangeConnections = 1);
+    //Ends the payload with its checksum (see PayloadChecksum), for peers that verify it. Call it after
+    //setTransferToken, uploads over several connections don't have one. Nor do resumed ones, so we
+    //don't have to read again what we sent before.
+    void setChecksumTrailer(bool enabled);
+    //The connection the peer made to send our token, we encrypt it as the TLS client. A peer resuming
+    //the download tells us how much it has and the checksum of it (see DownloadPayload).
+    void connectionReceived(QSslSocket* socket, qint64 offset = 0, const QByteArray& checksum = QByteArray());
+
     QVariantMap transferInfo();
 
+    qint64 sentBytes() const { return m_sent; }
+    //Bytes per second since it started sending, -1 before that
+    double throughput() const;
+
+    //Local files are sent from a memory mapping, so their data isn't copied before it is encrypted.
+    //If the file shrinks while we send it, the rest is read from the file instead.
+    enum InputMode { BufferedInput, MappedInput };
+    InputMode inputMode() const { return m_mapped? MappedInput : BufferedInput; }
+
+    const static quint16 MIN_PORT = 1739;
+    const static quint16 MAX_PORT = 1764;
+
+    //The input is written in chunks that grow from the minimum to the maximum size while the socket
+    //keeps up, with no more than s_chunksInFlight of them waiting in the socket
+    const static qint64 s_minChunkSize = 64 * 1024;
+    const static qint64 s_maxChunkSize = 1024 * 1024;
+    const static int s_chunksInFlight = 4;
+
+    //Files this big are offered over several connections to peers that support it
+    const static qint64 s_minRangedSize = 64 * 1024 * 1024;
+    const static int s_maxRangeConnections = 4;
+    //Each block is preceded by its offset (64 bits) and length (32 bits), big endian
+    const static qint64 s_rangeBlockSize = 1024 * 1024;
+    const static int s_rangeHeaderSize = 12;
+
+    //Uploads with a token wait this long for the peer to resume them after losing the connection
+    const static int s_resumeTimeout = 30000;
+
+Q_SIGNALS:
+    //The peer connected to receive the payload, again every time it resumes it
+    void peerConnected();
+
 private:
+    bool openInput();
+    bool setSocket(QSslSocket* socket);
+    bool canResume() const;
+    bool seekTo(qint64 offset, const QByteArray& checksum);
+    void waitForResume();
+    void addRangeSocket(QSslSocket* socket);
+    bool mappingCovers(qint64 end);
+    QByteArray readAt(qint64 offset, qint64 size);
+    QByteArray readChunk(qint64 maxSize);
+    qint64 inputAvailable() const;
+    bool inputAtEnd() const;
+
     const QSharedPointer<QIODevice> m_input;
-    Server * const m_server;
+    Server* m_server;
     QSslSocket* m_socket;
     quint16 m_port;
+    QString m_token;
     const QString m_deviceId;
+    qint64 m_chunkSize;
+    uchar* m_mapped;
+    qint64 m_mappedSize;
+    qint64 m_mappedOffset;
+    qint64 m_sent;
+    QElapsedTimer m_timer;
+    QTimer m_resumeTimer;
+    bool m_closing; //We disconnect after giving the socket the whole input
+    bool m_checksumTrailer;
+    PayloadChecksum m_checksum;
 
-    const static quint16 MIN_PORT = 1739;
-    const static quint16 MAX_PORT = 1764;
+    int m_rangeConnections;
+    QList<QSslSocket*> m_rangeSockets;
+    qint64 m_rangeCursor; //Where the next block starts
+    qint64 m_inputSize;
 
 private Q_SLOTS:
     void startUploading();
+    void sendRanges();
+    void rangeSocketClosed();
+    void resumeTimedOut();
     void newConnection();
     void aboutToClose();
     void cleanup();
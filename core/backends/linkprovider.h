@@ -44,6 +44,9 @@ public:
 
     virtual QString name() = 0;
     virtual int priority() = 0;
+    //Link level features (see NetworkPacket::linkCapabilities) its links implement. We advertise
+    //them in our identity, and only use those the peer advertises too.
+    virtual QStringList linkCapabilities() const { return QStringList(); }
 
 public Q_SLOTS:
     virtual void onStart() = 0;
@@ -22,10 +22,11 @@
 #define LOOPBACKDEVICELINK_H
 
 #include "../devicelink.h"
+#include "kdeconnectcore_export.h"
 
 class LoopbackLinkProvider;
 
-class LoopbackDeviceLink
+class KDECONNECTCORE_EXPORT LoopbackDeviceLink
     : public DeviceLink
 {
     Q_OBJECT
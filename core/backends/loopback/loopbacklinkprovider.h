@@ -23,9 +23,10 @@
 
 #include "../linkprovider.h"
 #include "loopbackdevicelink.h"
+#include "kdeconnectcore_export.h"
 #include <QPointer>
 
-class LoopbackLinkProvider
+class KDECONNECTCORE_EXPORT LoopbackLinkProvider
     : public LinkProvider
 {
     Q_OBJECT
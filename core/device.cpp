@@ -36,6 +36,7 @@
 #include "networkpacket.h"
 #include "kdeconnectconfig.h"
 #include "daemon.h"
+#include "transferscheduler.h"
 
 static void warn(const QString& info)
 {
@@ -46,7 +47,11 @@ Device::Device(QObject* parent, const QString& id)
     : QObject(parent)
     , m_deviceId(id)
     , m_protocolVersion(NetworkPacket::s_protocolVersion) //We don't know it yet
+    , m_transfers(new TransferScheduler(this))
 {
+    connect(m_transfers, &TransferScheduler::uploadReady, this, &Device::sendScheduledPacket);
+    connect(m_transfers, &TransferScheduler::transfersChanged, this, &Device::transfersChanged);
+
     KdeConnectConfig::DeviceInfo info = KdeConnectConfig::instance()->getTrustedDevice(id);
 
     m_deviceName = info.deviceName;
@@ -65,7 +70,11 @@ Device::Device(QObject* parent, const NetworkPacket& identityPacket, DeviceLink*
     : QObject(parent)
     , m_deviceId(identityPacket.get<QString>(QStringLiteral("deviceId")))
     , m_deviceName(identityPacket.get<QString>(QStringLiteral("deviceName")))
+    , m_transfers(new TransferScheduler(this))
 {
+    connect(m_transfers, &TransferScheduler::uploadReady, this, &Device::sendScheduledPacket);
+    connect(m_transfers, &TransferScheduler::transfersChanged, this, &Device::transfersChanged);
+
     addLink(identityPacket, dl);
 
     //Register in bus
@@ -93,7 +102,8 @@ QStringList Device::loadedPlugins() const
 void Device::reloadPlugins()
 {
     QHash<QString, KdeConnectPlugin*> newPluginMap, oldPluginMap = m_plugins;
-    QMultiMap<QString, KdeConnectPlugin*> newPluginsByIncomingCapability;
+    QHash<QString, int> newPacketTypeIds;
+    QVector<QVector<KdeConnectPlugin*>> pluginsByPacketType;
 
     if (isTrusted() && isReachable()) { //Do not load any plugin for unpaired devices, nor useless loading them for unreachable devices
 
@@ -114,7 +124,12 @@ void Device::reloadPlugins()
                 Q_ASSERT(plugin);
 
                 for (const QString& interface : incomingCapabilities) {
-                    newPluginsByIncomingCapability.insert(interface, plugin);
+                    auto typeId = newPacketTypeIds.constFind(interface);
+                    if (typeId == newPacketTypeIds.constEnd()) {
+                        typeId = newPacketTypeIds.insert(interface, pluginsByPacketType.size());
+                        pluginsByPacketType.append(QVector<KdeConnectPlugin*>());
+                    }
+                    pluginsByPacketType[*typeId].append(plugin);
                 }
 
                 newPluginMap[pluginName] = plugin;
@@ -128,7 +143,17 @@ void Device::reloadPlugins()
     //them anymore, otherwise they would have been moved to the newPluginMap)
     qDeleteAll(m_plugins);
     m_plugins = newPluginMap;
-    m_pluginsByIncomingCapability = newPluginsByIncomingCapability;
+
+    //Flatten it so dispatching a packet is a hash lookup and a walk over contiguous memory
+    m_packetTypeIds = newPacketTypeIds;
+    m_dispatchOffsets.clear();
+    m_dispatchOffsets.reserve(pluginsByPacketType.size() + 1);
+    m_dispatchTable.clear();
+    for (const QVector<KdeConnectPlugin*>& plugins : qAsConst(pluginsByPacketType)) {
+        m_dispatchOffsets.append(m_dispatchTable.size());
+        m_dispatchTable += plugins;
+    }
+    m_dispatchOffsets.append(m_dispatchTable.size());
 
     QDBusConnection bus = QDBusConnection::sessionBus();
     for (KdeConnectPlugin* plugin : qAsConst(m_plugins)) {
@@ -228,6 +253,8 @@ void Device::addLink(const NetworkPacket& identityPacket, DeviceLink* link)
 
     connect(link, &DeviceLink::receivedPacket,
             this, &Device::privateReceivedPacket);
+    connect(link, &DeviceLink::receivedPackets,
+            this, &Device::privateReceivedPackets);
 
     std::sort(m_deviceLinks.begin(), m_deviceLinks.end(), lessThan);
 
@@ -252,6 +279,7 @@ void Device::addLink(const NetworkPacket& identityPacket, DeviceLink* link)
     connect(link, &DeviceLink::pairingRequest, this, &Device::addPairingRequest);
     connect(link, &DeviceLink::pairingRequestExpired, this, &Device::removePairingRequest);
     connect(link, &DeviceLink::pairingError, this, &Device::pairingError);
+    connect(link, &DeviceLink::payloadStarted, m_transfers, &TransferScheduler::uploadStarted);
 }
 
 void Device::addPairingRequest(PairingHandler* handler)
@@ -307,6 +335,7 @@ void Device::linkDestroyed(QObject* o)
 void Device::removeLink(DeviceLink* link)
 {
     m_deviceLinks.removeAll(link);
+    m_linkSelector.linkRemoved(link);
 
     //qCDebug(KDECONNECT_CORE) << "RemoveLink" << m_deviceLinks.size() << "links remaining";
 
@@ -321,25 +350,52 @@ bool Device::sendPacket(NetworkPacket& np)
     Q_ASSERT(np.type() != PACKET_TYPE_PAIR);
     Q_ASSERT(isTrusted());
 
+    //Packets with a payload are sent when the scheduler has room for their transfer, if
+    //no link could take them now they would only fail later
+    if (np.hasPayload() && isReachable()) {
+        const bool canSend = std::any_of(m_deviceLinks.constBegin(), m_deviceLinks.constEnd(), [](DeviceLink* dl) {
+            return !dl->isQueueFull();
+        });
+        if (canSend) {
+            m_transfers->enqueueUpload(np);
+        }
+        return canSend;
+    }
+    return sendPacketNow(np);
+}
+
+bool Device::sendPacketNow(NetworkPacket& np)
+{
     //Maybe we could block here any packet that is not an identity or a pairing packet to prevent sending non encrypted data
-    for (DeviceLink* dl : qAsConst(m_deviceLinks)) {
+    LinkSelector::Traffic traffic = LinkSelector::Interactive;
+    if (np.hasPayload()) {
+        traffic = LinkSelector::Payload;
+    } else if (PluginLoader::instance()->isBulkPacketType(np.type())) {
+        traffic = LinkSelector::Bulk;
+    }
+    const QVector<DeviceLink*> links = m_linkSelector.order(m_deviceLinks, traffic);
+    for (DeviceLink* dl : links) {
         if (dl->sendPacket(np)) return true;
     }
 
     return false;
 }
 
+void Device::sendScheduledPacket(const NetworkPacket& np)
+{
+    NetworkPacket packet = np;
+    if (!sendPacketNow(packet)) {
+        qCWarning(KDECONNECT_CORE) << "Couldn't send" << packet.type() << "with its payload to" << name();
+        m_transfers->release(packet.payload().data());
+    }
+}
+
 void Device::privateReceivedPacket(const NetworkPacket& np)
 {
     Q_ASSERT(np.type() != PACKET_TYPE_PAIR);
     if (isTrusted()) {
-        const QList<KdeConnectPlugin*> plugins = m_pluginsByIncomingCapability.values(np.type());
-        if (plugins.isEmpty()) {
-            qWarning() << "discarding unsupported packet" << np.type() << "for" << name();
-        }
-        for (KdeConnectPlugin* plugin : plugins) {
-            plugin->receivePacket(np);
-        }
+        schedulePayload(np);
+        dispatchPacket(np);
     } else {
         qCDebug(KDECONNECT_CORE) << "device" << name() << "not paired, ignoring packet" << np.type();
         unpair();
@@ -347,6 +403,62 @@ void Device::privateReceivedPacket(const NetworkPacket& np)
 
 }
 
+void Device::privateReceivedPackets(const QVector<NetworkPacket>& packets)
+{
+    if (isTrusted()) {
+        for (const NetworkPacket& np : packets) {
+            Q_ASSERT(np.type() != PACKET_TYPE_PAIR);
+            schedulePayload(np);
+            dispatchPacket(np);
+        }
+    } else {
+        qCDebug(KDECONNECT_CORE) << "device" << name() << "not paired, ignoring" << packets.size() << "packets";
+        unpair();
+    }
+}
+
+void Device::dispatchPacket(const NetworkPacket& np)
+{
+    const int typeId = m_packetTypeIds.value(np.type(), -1);
+    if (typeId < 0) {
+        qWarning() << "discarding unsupported packet" << np.type() << "for" << name();
+        return;
+    }
+    //Shallow copies, in case a plugin makes us reload them while we iterate
+    const QVector<KdeConnectPlugin*> table = m_dispatchTable;
+    const QVector<int> offsets = m_dispatchOffsets;
+    for (int i = offsets[typeId], end = offsets[typeId + 1]; i < end; ++i) {
+        table[i]->receivePacket(np);
+    }
+}
+
+void Device::schedulePayload(const NetworkPacket& np)
+{
+    //Starting a download only begins connecting, the plugins can still prepare it (eg: to resume it)
+    if (TransferScheduler::needsScheduling(np.payload().data())) {
+        m_transfers->enqueueDownload(np.payload(), np.payloadSize());
+    }
+}
+
+int Device::activeTransfers() const
+{
+    return m_transfers->activeTransfers();
+}
+
+int Device::queuedTransfers() const
+{
+    return m_transfers->queuedTransfers();
+}
+
+int Device::queuedPackets() const
+{
+    int ret = 0;
+    for (DeviceLink* dl : qAsConst(m_deviceLinks)) {
+        ret += dl->queuedPackets();
+    }
+    return ret;
+}
+
 bool Device::isTrusted() const
 {
     return KdeConnectConfig::instance()->trustedDevices().contains(id());
@@ -362,6 +474,20 @@ QStringList Device::availableLinks() const
     return sl;
 }
 
+QVariantMap Device::linkStatistics() const
+{
+    QVariantMap statistics;
+    for (DeviceLink* dl : qAsConst(m_deviceLinks)) {
+        statistics.insert(dl->provider()->name(), QVariantMap{
+            {QStringLiteral("roundTripTime"), dl->roundTripTime()},
+            {QStringLiteral("jitter"), dl->roundTripJitter()},
+            {QStringLiteral("throughput"), dl->throughput()},
+            {QStringLiteral("errorRate"), dl->errorRate()},
+        });
+    }
+    return statistics;
+}
+
 void Device::cleanUnneededLinks() {
     if (isTrusted()) {
         return;
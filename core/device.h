@@ -29,9 +29,11 @@
 
 #include "networkpacket.h"
 #include "backends/devicelink.h"
+#include "linkselector.h"
 
 class DeviceLink;
 class KdeConnectPlugin;
+class TransferScheduler;
 
 class KDECONNECTCORE_EXPORT Device
     : public QObject
@@ -88,6 +90,9 @@ public:
     Q_SCRIPTABLE bool isTrusted() const;
 
     Q_SCRIPTABLE QStringList availableLinks() const;
+    //What each link measures of itself, by the name in availableLinks(): round trip time and jitter (in ms),
+    //throughput (in bytes per second) or -1 when unknown, and the share of packets it failed to send
+    Q_SCRIPTABLE QVariantMap linkStatistics() const;
     bool isReachable() const { return !m_deviceLinks.isEmpty(); }
 
     Q_SCRIPTABLE QStringList loadedPlugins() const;
@@ -106,8 +111,16 @@ public:
 
     QHostAddress getLocalIpAddress() const;
 
+    //Packets we sent that the links are still holding, because the device is not reading them fast enough
+    int queuedPackets() const;
+
+    //Payloads being transferred and waiting for their turn (see TransferScheduler)
+    Q_SCRIPTABLE int activeTransfers() const;
+    Q_SCRIPTABLE int queuedTransfers() const;
+
 public Q_SLOTS:
     ///sends a @p np packet to the device
+    ///packets with a payload may wait for other transfers, they are dropped if no link can send them then
     ///virtual for testing purposes.
     virtual bool sendPacket(NetworkPacket& np);
 
@@ -123,10 +136,12 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void privateReceivedPacket(const NetworkPacket& np);
+    void privateReceivedPackets(const QVector<NetworkPacket>& packets);
     void linkDestroyed(QObject* o);
     void pairStatusChanged(DeviceLink::PairStatus current);
     void addPairingRequest(PairingHandler* handler);
     void removePairingRequest(PairingHandler* handler);
+    void sendScheduledPacket(const NetworkPacket& np);
 
 Q_SIGNALS:
     Q_SCRIPTABLE void pluginsChanged();
@@ -136,12 +151,16 @@ Q_SIGNALS:
     Q_SCRIPTABLE void nameChanged(const QString& name);
 
     Q_SCRIPTABLE void hasPairingRequestsChanged(bool hasPairingRequests);
+    Q_SCRIPTABLE void transfersChanged(int active, int queued);
 
 private: //Methods
     static DeviceType str2type(const QString& deviceType);
     static QString type2str(DeviceType deviceType);
 
     void setName(const QString& name);
+    void dispatchPacket(const NetworkPacket& np);
+    void schedulePayload(const NetworkPacket& np);
+    bool sendPacketNow(NetworkPacket& np);
     QString iconForStatus(bool reachable, bool paired) const;
 
 private: //Fields (TODO: dPointer!)
@@ -154,9 +173,16 @@ private: //Fields (TODO: dPointer!)
     QHash<QString, KdeConnectPlugin*> m_plugins;
 
     //Capabilities stuff
-    QMultiMap<QString, KdeConnectPlugin*> m_pluginsByIncomingCapability;
+    //Incoming packet types are numbered when plugins are (re)loaded. The plugins handling type n are
+    //m_dispatchTable[m_dispatchOffsets[n]] to m_dispatchTable[m_dispatchOffsets[n+1]-1]
+    QHash<QString, int> m_packetTypeIds;
+    QVector<int> m_dispatchOffsets;
+    QVector<KdeConnectPlugin*> m_dispatchTable;
     QSet<QString> m_supportedPlugins;
     QSet<PairingHandler*> m_pairRequests;
+
+    TransferScheduler* m_transfers;
+    LinkSelector m_linkSelector;
 };
 
 Q_DECLARE_METATYPE(Device*)
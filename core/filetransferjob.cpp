@@ -21,14 +21,24 @@
 
 #include "filetransferjob.h"
 #include "daemon.h"
+#include "networkpacket.h"
+#include "transferscheduler.h"
 #include <core_debug.h>
 
 #include <qalgorithms.h>
 #include <QFileInfo>
 #include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 #include <KLocalizedString>
 
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+const qint64 FileTransferJob::s_writeSize;
+
 FileTransferJob::FileTransferJob(const QSharedPointer<QIODevice>& origin, qint64 size, const QUrl& destination)
     : KJob()
     , m_origin(origin)
@@ -38,6 +48,7 @@ FileTransferJob::FileTransferJob(const QSharedPointer<QIODevice>& origin, qint64
     , m_speedBytes(0)
     , m_written(0)
     , m_size(size)
+    , m_resumeOffset(0)
 {
     Q_ASSERT(m_origin);
     Q_ASSERT(m_origin->isReadable());
@@ -52,6 +63,10 @@ FileTransferJob::FileTransferJob(const QSharedPointer<QIODevice>& origin, qint64
 
 void FileTransferJob::start()
 {
+    //Has to happen before the origin starts receiving
+    if (m_destination.isLocalFile()) {
+        prepareResume();
+    }
     QMetaObject::invokeMethod(this, "doStart", Qt::QueuedConnection);
     //qCDebug(KDECONNECT_CORE) << "FileTransferJob start";
 }
@@ -69,6 +84,11 @@ void FileTransferJob::doStart()
         return;
     }
 
+    if (m_destination.isLocalFile()) {
+        startLocalTransfer();
+        return;
+    }
+
     if (m_origin->bytesAvailable())
         startTransfer();
     connect(m_origin.data(), &QIODevice::readyRead, this, &FileTransferJob::startTransfer);
@@ -125,8 +145,200 @@ void FileTransferJob::transferFinished()
     emitResult();
 }
 
+void FileTransferJob::prepareResume()
+{
+    QFile stateFile(statePath());
+    if (m_size <= 0 || !stateFile.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    //Only if it looks like the same payload, the origin checks the data itself
+    const QJsonObject state = QJsonDocument::fromJson(stateFile.readAll()).object();
+    if (state.value(QStringLiteral("size")).toVariant().toLongLong() != m_size || state.value(QStringLiteral("from")).toString() != m_from) {
+        return;
+    }
+
+    QFile part(partPath());
+    const qint64 offset = part.size();
+    if (offset <= 0 || offset >= m_size || !part.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const qint64 checked = qMin(offset, NetworkPacket::s_resumeCheckSize);
+    part.seek(offset - checked);
+    const QByteArray tail = part.read(checked);
+
+    ScheduledPayload* origin = qobject_cast<ScheduledPayload*>(m_origin.data());
+    if (!origin || !origin->resumeFrom(offset, tail)) {
+        //The origin sends everything again, what we had can't be kept
+        qCDebug(KDECONNECT_CORE) << "Can't resume transfer to" << m_destination << ", starting over";
+        part.close();
+        part.resize(0);
+        return;
+    }
+    qCDebug(KDECONNECT_CORE) << "Resuming transfer to" << m_destination << "at" << offset;
+    m_resumeOffset = offset;
+}
+
+void FileTransferJob::startLocalTransfer()
+{
+    m_partFile.setFileName(partPath());
+    //We do the buffering ourselves, see readOrigin
+    const QIODevice::OpenMode mode = QIODevice::WriteOnly | QIODevice::Unbuffered | (m_resumeOffset > 0? QIODevice::Append : QIODevice::Truncate);
+    if (!m_partFile.open(mode)) {
+        setError(3);
+        setErrorText(i18n("Couldn't write to %1: %2", m_partFile.fileName(), m_partFile.errorString()));
+        emitResult();
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    //Reserving the space up front keeps the file from fragmenting. The size stays what we wrote, so the
+    //partial file still tells how much we have. Not every filesystem supports it, it's fine if it fails.
+    if (m_size > m_resumeOffset) {
+        fallocate(m_partFile.handle(), FALLOC_FL_KEEP_SIZE, m_resumeOffset, m_size - m_resumeOffset);
+    }
+#endif
+    m_writeBuffer.reserve(int(s_writeSize));
+
+    if (m_size > 0) {
+        QFile stateFile(statePath());
+        if (stateFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QJsonObject state;
+            state.insert(QStringLiteral("size"), m_size);
+            state.insert(QStringLiteral("from"), m_from);
+            stateFile.write(QJsonDocument(state).toJson(QJsonDocument::Compact));
+        }
+    }
+
+    description(this, i18n("Receiving file over KDE Connect"),
+                        { i18nc("File transfer origin", "From"), m_from },
+                        { i18nc("File transfer destination", "To"), m_destination.toLocalFile() });
+    if (m_size >= 0) {
+        setTotalAmount(Bytes, m_size);
+    }
+    m_written = m_resumeOffset;
+    setProcessedAmount(Bytes, m_written);
+
+    connect(m_origin.data(), &QIODevice::readyRead, this, &FileTransferJob::readOrigin);
+    connect(m_origin.data(), &QIODevice::readChannelFinished, this, &FileTransferJob::originFinished);
+    readOrigin();
+}
+
+void FileTransferJob::readOrigin()
+{
+    if (!m_partFile.isOpen()) {
+        return;
+    }
+
+    //Writes are s_writeSize long and start at multiples of it, whatever the origin gives us each time
+    while (m_origin->bytesAvailable() > 0) {
+        const int buffered = m_writeBuffer.size();
+        const qint64 wanted = qMin(m_origin->bytesAvailable(), s_writeSize - m_written % s_writeSize);
+        m_writeBuffer.resize(buffered + int(wanted));
+        const qint64 size = m_origin->read(m_writeBuffer.data() + buffered, wanted);
+        m_writeBuffer.resize(buffered + int(qMax<qint64>(size, 0)));
+        if (size <= 0) {
+            break;
+        }
+        m_written += size;
+        if (m_written % s_writeSize == 0 && !flushWrites()) {
+            return;
+        }
+    }
+
+    if (!m_timer.isValid())
+        m_timer.start();
+    setProcessedAmount(Bytes, m_written);
+    const auto elapsed = m_timer.elapsed();
+    if (elapsed > 0) {
+        emitSpeed((1000 * (m_written - m_resumeOffset)) / elapsed);
+    }
+
+    //Sequential origins of unknown size tell us they are done with readChannelFinished
+    if ((m_size > 0 && m_written >= m_size) || (!m_origin->isSequential() && m_origin->atEnd())) {
+        finishLocalTransfer();
+    }
+}
+
+void FileTransferJob::originFinished()
+{
+    readOrigin();
+    if (!m_partFile.isOpen()) {
+        return;
+    }
+
+    if (m_size > 0 && m_written != m_size) {
+        failLocalTransfer(i18n("Received incomplete file: %1", m_origin->errorString()));
+    } else {
+        finishLocalTransfer();
+    }
+}
+
+bool FileTransferJob::flushWrites()
+{
+    if (m_writeBuffer.isEmpty()) {
+        return true;
+    }
+    if (m_partFile.write(m_writeBuffer) != m_writeBuffer.size()) {
+        m_writeBuffer.resize(0);
+        failLocalTransfer(i18n("Couldn't write to %1: %2", m_partFile.fileName(), m_partFile.errorString()));
+        return false;
+    }
+    m_writeBuffer.resize(0);
+    return true;
+}
+
+void FileTransferJob::finishLocalTransfer()
+{
+    if (!flushWrites()) {
+        return;
+    }
+    m_origin->disconnect(this);
+    m_partFile.close();
+    QFile::remove(statePath());
+
+    if (QFile::exists(m_destination.toLocalFile()) || !m_partFile.rename(m_destination.toLocalFile())) {
+        setError(2);
+        setErrorText(i18n("Couldn't move %1 to %2", m_partFile.fileName(), m_destination.toLocalFile()));
+    } else {
+        qCDebug(KDECONNECT_CORE) << "Finished transfer" << m_destination;
+    }
+    emitResult();
+}
+
+void FileTransferJob::failLocalTransfer(const QString& error)
+{
+    qCDebug(KDECONNECT_CORE) << "Couldn't transfer the file successfully" << error;
+    m_origin->disconnect(this);
+    if (!m_writeBuffer.isEmpty()) {
+        //Whatever we can still keep of it
+        m_partFile.write(m_writeBuffer);
+        m_writeBuffer.clear();
+    }
+    m_written = m_partFile.size();
+    m_partFile.close();
+
+    //What we have is kept for a later transfer of the same payload to resume
+    if (m_written == 0 || m_size <= 0) {
+        m_partFile.remove();
+        QFile::remove(statePath());
+    }
+
+    setError(3);
+    setErrorText(error);
+    emitResult();
+}
+
 bool FileTransferJob::doKill()
 {
+    //Cancelled on purpose, so there is nothing to resume
+    if (m_partFile.isOpen()) {
+        m_origin->disconnect(this);
+        m_partFile.close();
+        m_partFile.remove();
+        QFile::remove(statePath());
+    }
+
     if (m_reply) {
         m_reply->close();
     }
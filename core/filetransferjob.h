@@ -25,6 +25,7 @@
 #include <KJob>
 
 #include <QElapsedTimer>
+#include <QFile>
 #include <QIODevice>
 #include <QSharedPointer>
 #include <QUrl>
@@ -37,6 +38,11 @@
  *
  * Given a QIODevice, the file transfer job will use the system's QNetworkAccessManager
  * for putting the stream into the requested location.
+ *
+ * Local destinations are written to a partial file next to them instead, with a state file
+ * describing it. When a transfer fails, both are kept, and a later transfer of the same payload
+ * continues from there if its origin can resume (see ScheduledPayload::resumeFrom). If it
+ * can't, the transfer starts over.
  */
 class KDECONNECTCORE_EXPORT FileTransferJob
     : public KJob
@@ -54,8 +60,13 @@ public:
     QUrl destination() const { return m_destination; }
     void setOriginName(const QString& from) { m_from = from; }
 
+    //Local destinations are written in blocks of this size
+    const static qint64 s_writeSize = 1024 * 1024;
+
 private Q_SLOTS:
     void doStart();
+    void readOrigin();
+    void originFinished();
 
 protected:
     bool doKill() override;
@@ -65,6 +76,14 @@ private:
     void transferFailed(QNetworkReply::NetworkError error);
     void transferFinished();
 
+    QString partPath() const { return m_destination.toLocalFile() + QStringLiteral(".part"); }
+    QString statePath() const { return partPath() + QStringLiteral(".json"); }
+    void prepareResume();
+    void startLocalTransfer();
+    bool flushWrites();
+    void finishLocalTransfer();
+    void failLocalTransfer(const QString& error);
+
     QSharedPointer<QIODevice> m_origin;
     QNetworkReply* m_reply;
     QString m_from;
@@ -73,6 +92,9 @@ private:
     qulonglong m_speedBytes;
     qint64 m_written;
     qint64 m_size;
+    QFile m_partFile;
+    QByteArray m_writeBuffer;
+    qint64 m_resumeOffset;
 };
 
 #endif
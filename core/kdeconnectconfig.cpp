@@ -51,6 +51,8 @@ struct KdeConnectConfigPrivate {
     QSettings* m_config;
     QSettings* m_trustedDevices;
 
+    QString m_name; //Cached, it's read every time we send our identity
+
 };
 
 KdeConnectConfig* KdeConnectConfig::instance()
@@ -148,15 +150,18 @@ KdeConnectConfig::KdeConnectConfig()
 
 QString KdeConnectConfig::name()
 {
-    QString defaultName = qgetenv("USER") + '@' + QHostInfo::localHostName();
-    QString name = d->m_config->value(QStringLiteral("name"), defaultName).toString();
-    return name;
+    if (d->m_name.isEmpty()) {
+        QString defaultName = qgetenv("USER") + '@' + QHostInfo::localHostName();
+        d->m_name = d->m_config->value(QStringLiteral("name"), defaultName).toString();
+    }
+    return d->m_name;
 }
 
 void KdeConnectConfig::setName(const QString& name)
 {
     d->m_config->setValue(QStringLiteral("name"), name);
     d->m_config->sync();
+    d->m_name = name;
 }
 
 QString KdeConnectConfig::deviceType()
@@ -256,6 +261,27 @@ QString KdeConnectConfig::getDeviceProperty(const QString& deviceId, const QStri
     return value;
 }
 
+void KdeConnectConfig::setLastAddress(const QString& deviceId, const QHostAddress& address)
+{
+    d->m_trustedDevices->beginGroup(deviceId);
+    //We get here on every connection, only write to disk when something changed
+    const bool changed = d->m_trustedDevices->value(QStringLiteral("lastAddress")).toString() != address.toString();
+    if (changed) {
+        d->m_trustedDevices->setValue(QStringLiteral("lastAddress"), address.toString());
+    }
+    d->m_trustedDevices->endGroup();
+    if (changed) {
+        d->m_trustedDevices->sync();
+    }
+}
+
+QHostAddress KdeConnectConfig::getLastAddress(const QString& deviceId)
+{
+    d->m_trustedDevices->beginGroup(deviceId);
+    const QHostAddress address(d->m_trustedDevices->value(QStringLiteral("lastAddress")).toString());
+    d->m_trustedDevices->endGroup();
+    return address;
+}
 
 QDir KdeConnectConfig::deviceConfigDir(const QString& deviceId)
 {
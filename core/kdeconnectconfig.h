@@ -22,6 +22,7 @@
 #define KDECONNECTCONFIG_H
 
 #include <QDir>
+#include <QHostAddress>
 
 #include "kdeconnectcore_export.h"
 
@@ -70,6 +71,11 @@ public:
     void setDeviceProperty(const QString& deviceId, const QString& name, const QString& value);
     QString getDeviceProperty(const QString& deviceId, const QString& name, const QString& defaultValue = QString());
 
+    //Where we were last connected to a trusted device, to tell it we are here directly instead of
+    //waiting for a broadcast to reach it
+    void setLastAddress(const QString& deviceId, const QHostAddress& address);
+    QHostAddress getLastAddress(const QString& deviceId);
+
     /*
      * Paths for config files, there is no guarantee the directories already exist
      */
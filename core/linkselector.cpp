@@ -0,0 +1,98 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "linkselector.h"
+
+#include "core_debug.h"
+#include "backends/devicelink.h"
+
+const int LinkSelector::s_defaultRoundTrip;
+const qint64 LinkSelector::s_defaultThroughput;
+const qint64 LinkSelector::s_referenceSize;
+const int LinkSelector::s_switchMargin;
+const int LinkSelector::s_holdTime;
+
+LinkSelector::LinkSelector()
+{
+    m_choices[Interactive].link = nullptr;
+    m_choices[Bulk].link = nullptr;
+    m_choices[Payload].link = nullptr;
+}
+
+QVector<DeviceLink*> LinkSelector::order(const QVector<DeviceLink*>& links, Traffic traffic)
+{
+    if (links.size() < 2) {
+        return links;
+    }
+
+    DeviceLink* best = nullptr;
+    double bestCost = 0;
+    for (DeviceLink* link : links) {
+        const double linkCost = cost(link, traffic);
+        if (!best || linkCost < bestCost) {
+            best = link;
+            bestCost = linkCost;
+        }
+    }
+
+    Choice& choice = m_choices[traffic];
+    if (choice.link != best) {
+        const bool current = choice.link && links.contains(choice.link);
+        if (!current || (choice.chosen.hasExpired(s_holdTime)
+                         && bestCost < cost(choice.link, traffic) * (100 - s_switchMargin) / 100)) {
+            if (current) {
+                qCDebug(KDECONNECT_CORE) << "Switching" << (traffic == Interactive? "interactive" : traffic == Bulk? "bulk" : "payload") << "traffic for"
+                                         << best->deviceId() << "to" << best->name() << "expected" << bestCost << "ms";
+            }
+            choice.link = best;
+            choice.chosen.start();
+        }
+    }
+
+    //The rest stay in priority order, in case the chosen one can't take the packet
+    QVector<DeviceLink*> ordered = links;
+    ordered.removeOne(choice.link);
+    ordered.prepend(choice.link);
+    return ordered;
+}
+
+void LinkSelector::linkRemoved(DeviceLink* link)
+{
+    for (Choice& choice : m_choices) {
+        if (choice.link == link) {
+            choice.link = nullptr;
+        }
+    }
+}
+
+double LinkSelector::cost(const DeviceLink* link, Traffic traffic)
+{
+    const double rtt = link->roundTripTime() < 0? s_defaultRoundTrip : link->roundTripTime() + 4 * qMax(0.0, link->roundTripJitter());
+    const double throughput = link->throughput() > 0? link->throughput() : s_defaultThroughput;
+
+    //Whatever is queued goes first
+    double time = rtt + link->queuedBytes() * 1000.0 / throughput;
+    if (traffic == Bulk) {
+        time += s_referenceSize * 1000.0 / throughput;
+    } else if (traffic == Payload) {
+        time += s_referenceSize * 1000.0 / (link->payloadThroughput() > 0? link->payloadThroughput() : s_defaultThroughput);
+    }
+    return time / (1 - qMin(link->errorRate(), 0.9));
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINKSELECTOR_H
+#define LINKSELECTOR_H
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "kdeconnectcore_export.h"
+
+class DeviceLink;
+
+/*
+ * Chooses which of the links to a device a packet goes through, from what the links measure of
+ * themselves instead of only the priority of their providers.
+ *
+ * Interactive packets go through the link where they would arrive first: the one with the lowest
+ * round trip time (plus four times its variation), counting what is already queued in front of
+ * them. Bulk packets go through the one that would send s_referenceSize bytes first, and so do
+ * packets with a payload, at the rate the link sends payloads (see
+ * DeviceLink::payloadThroughput), which may not be that of the packets. Links that lose packets
+ * cost more, as they'll have to be resent.
+ * Links that don't measure something are assumed to be average at it (s_defaultRoundTrip,
+ * s_defaultThroughput), so equal links keep the order of their providers.
+ *
+ * To not bounce between links with similar numbers, we only switch to a link that is
+ * s_switchMargin percent better than the current one, and not more than once per s_holdTime.
+ * If the current link goes away we switch right away.
+ */
+class KDECONNECTCORE_EXPORT LinkSelector
+{
+public:
+    enum Traffic { Interactive, Bulk, Payload };
+
+    LinkSelector();
+
+    //links in the order of their providers' priority, the best one is returned first
+    QVector<DeviceLink*> order(const QVector<DeviceLink*>& links, Traffic traffic);
+    void linkRemoved(DeviceLink* link);
+
+    //Estimated milliseconds for traffic of that kind to get through the link
+    static double cost(const DeviceLink* link, Traffic traffic);
+
+    const static int s_defaultRoundTrip = 100;
+    const static qint64 s_defaultThroughput = 1024 * 1024;
+    const static qint64 s_referenceSize = 1024 * 1024;
+    const static int s_switchMargin = 25;
+    const static int s_holdTime = 5000;
+
+private:
+    struct Choice {
+        DeviceLink* link;
+        QElapsedTimer chosen;
+    };
+    Choice m_choices[3];
+};
+
+#endif
@@ -24,10 +24,15 @@
 #include <QMetaObject>
 #include <QMetaProperty>
 #include <QByteArray>
+#include <QCryptographicHash>
 #include <QDataStream>
 #include <QDateTime>
 #include <QJsonDocument>
 #include <QDebug>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QCborMap>
+#include <QCborValue>
+#endif
 
 #include "dbushelper.h"
 #include "filetransferjob.h"
@@ -45,6 +50,14 @@ QDebug operator<<(QDebug s, const NetworkPacket& pkg)
 }
 
 const int NetworkPacket::s_protocolVersion = 7;
+const char NetworkPacket::s_cborFrameMarker;
+const int NetworkPacket::s_frameHeaderSize;
+const char NetworkPacket::s_streamDataMarker;
+const char NetworkPacket::s_streamWindowMarker;
+const char NetworkPacket::s_streamCloseMarker;
+const char NetworkPacket::s_heartbeatPingMarker;
+const char NetworkPacket::s_heartbeatPongMarker;
+const qint64 NetworkPacket::s_resumeCheckSize;
 
 NetworkPacket::NetworkPacket(const QString& type, const QVariantMap& body)
     : m_id(QString::number(QDateTime::currentMSecsSinceEpoch()))
@@ -55,23 +68,55 @@ NetworkPacket::NetworkPacket(const QString& type, const QVariantMap& body)
 {
 }
 
-void NetworkPacket::createIdentityPacket(NetworkPacket* np)
+void NetworkPacket::createIdentityPacket(NetworkPacket* np, const QStringList& linkCapabilities)
 {
+    //Only the name can change while we are running, everything else is built once
+    static QVariantMap identityBody;
     KdeConnectConfig* config = KdeConnectConfig::instance();
+    const QString name = config->name();
+    if (identityBody.isEmpty() || identityBody.value(QStringLiteral("deviceName")).toString() != name) {
+        identityBody.clear();
+        identityBody.insert(QStringLiteral("deviceId"), config->deviceId());
+        identityBody.insert(QStringLiteral("deviceName"), name);
+        identityBody.insert(QStringLiteral("deviceType"), config->deviceType());
+        identityBody.insert(QStringLiteral("protocolVersion"),  NetworkPacket::s_protocolVersion);
+        identityBody.insert(QStringLiteral("incomingCapabilities"), PluginLoader::instance()->incomingCapabilities());
+        identityBody.insert(QStringLiteral("outgoingCapabilities"), PluginLoader::instance()->outgoingCapabilities());
+    }
+
     np->m_id = QString::number(QDateTime::currentMSecsSinceEpoch());
     np->m_type = PACKET_TYPE_IDENTITY;
     np->m_payload = QSharedPointer<QIODevice>();
     np->m_payloadSize = 0;
-    np->set(QStringLiteral("deviceId"), config->deviceId());
-    np->set(QStringLiteral("deviceName"), config->name());
-    np->set(QStringLiteral("deviceType"), config->deviceType());
-    np->set(QStringLiteral("protocolVersion"),  NetworkPacket::s_protocolVersion);
-    np->set(QStringLiteral("incomingCapabilities"), PluginLoader::instance()->incomingCapabilities());
-    np->set(QStringLiteral("outgoingCapabilities"), PluginLoader::instance()->outgoingCapabilities());
+    np->setBody(identityBody);
+    np->set(QStringLiteral("linkCapabilities"), linkCapabilities);
 
     //qCDebug(KDECONNECT_CORE) << "createIdentityPacket" << np->serialize();
 }
 
+QStringList NetworkPacket::linkCapabilities()
+{
+    QStringList ret;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    ret.append(LINK_CAPABILITY_CBOR);
+#endif
+    ret.append(LINK_CAPABILITY_PAYLOAD_STREAMS);
+    ret.append(LINK_CAPABILITY_PAYLOAD_TOKENS);
+    ret.append(LINK_CAPABILITY_PAYLOAD_RANGES);
+    ret.append(LINK_CAPABILITY_PAYLOAD_CHECKSUMS);
+    ret.append(LINK_CAPABILITY_HEARTBEAT);
+    return ret;
+}
+
+qint64 NetworkPacket::binaryFrameSize(const char* data, qint64 available)
+{
+    if (available < s_frameHeaderSize) {
+        return -1;
+    }
+    const uchar* length = reinterpret_cast<const uchar*>(data + 1);
+    return s_frameHeaderSize + ((quint32(length[0]) << 24) | (quint32(length[1]) << 16) | (quint32(length[2]) << 8) | quint32(length[3]));
+}
+
 template<class T>
 QVariantMap qobject2qvariant(const T* object)
 {
@@ -85,8 +130,35 @@ QVariantMap qobject2qvariant(const T* object)
     return map;
 }
 
-QByteArray NetworkPacket::serialize() const
+QByteArray NetworkPacket::serialize(WireFormat format) const
 {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    if (format == CborFormat) {
+        QCborMap map;
+        map.insert(QStringLiteral("id"), m_id);
+        map.insert(QStringLiteral("type"), m_type);
+        map.insert(QStringLiteral("body"), QCborMap::fromVariantMap(body()));
+        if (hasPayload()) {
+            map.insert(QStringLiteral("payloadSize"), payloadSize());
+            map.insert(QStringLiteral("payloadTransferInfo"), QCborMap::fromVariantMap(m_payloadTransferInfo));
+        }
+
+        const QByteArray cbor = map.toCborValue().toCbor();
+        const quint32 length = cbor.size();
+        QByteArray frame;
+        frame.reserve(s_frameHeaderSize + cbor.size());
+        frame.append(s_cborFrameMarker);
+        frame.append(char(length >> 24));
+        frame.append(char(length >> 16));
+        frame.append(char(length >> 8));
+        frame.append(char(length));
+        frame.append(cbor);
+        return frame;
+    }
+#else
+    Q_ASSERT(format == JsonFormat);
+#endif
+
     //Object -> QVariant
     //QVariantMap variant;
     //variant["id"] = mId;
@@ -115,46 +187,563 @@ QByteArray NetworkPacket::serialize() const
     return json;
 }
 
-template <class T>
-void qvariant2qobject(const QVariantMap& variant, T* object)
+namespace {
+
+/**
+ * Minimal JSON reader that decodes straight into the Qt types used by
+ * NetworkPacket, so we don't need to go through QJsonDocument, then QVariant
+ * and then QMetaProperty for every received line.
+ */
+class JsonReader
 {
-    for ( QVariantMap::const_iterator iter = variant.begin(); iter != variant.end(); ++iter )
+public:
+    explicit JsonReader(const QByteArray& json)
+        : m_pos(json.constData())
+        , m_end(json.constData() + json.size())
+    {
+    }
+
+    JsonReader(const char* begin, const char* end)
+        : m_pos(begin)
+        , m_end(end)
+    {
+    }
+
+    bool atEnd()
     {
-        const int propertyIndex = T::staticMetaObject.indexOfProperty(iter.key().toLatin1());
-        if (propertyIndex < 0) {
-            qCWarning(KDECONNECT_CORE) << "missing property" << object << iter.key();
+        skipWhitespace();
+        return m_pos == m_end;
+    }
+
+    bool consume(char c)
+    {
+        skipWhitespace();
+        if (m_pos == m_end || *m_pos != c) {
+            return false;
+        }
+        ++m_pos;
+        return true;
+    }
+
+    bool peek(char c)
+    {
+        skipWhitespace();
+        return m_pos != m_end && *m_pos == c;
+    }
+
+    bool readString(QString* out);
+    bool readValue(QVariant* out, int depth = 0);
+    bool readObject(QVariantMap* out, int depth = 0);
+    bool readList(QVariantList* out, int depth = 0);
+    bool readNumberToken(QByteArray* out);
+    bool skipValue(int depth = 0);
+
+    //Reads a JSON object, storing the offset (relative to the opening brace) and length of each member's value instead of decoding it
+    bool indexObject(QHash<QString, QPair<int, int>>* out);
+
+    const char* position() const { return m_pos; }
+
+private:
+    void skipWhitespace()
+    {
+        while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t')) {
+            ++m_pos;
+        }
+    }
+
+    bool readLiteral(const char* literal, int length)
+    {
+        if (m_end - m_pos < length || qstrncmp(m_pos, literal, length) != 0) {
+            return false;
+        }
+        m_pos += length;
+        return true;
+    }
+
+    bool readHex4(ushort* out);
+    bool readNumber(QVariant* out);
+    bool skipString();
+
+    //Same nesting limit QJsonDocument uses
+    static const int s_maxDepth = 1024;
+
+    const char* m_pos;
+    const char* const m_end;
+};
+
+bool JsonReader::readHex4(ushort* out)
+{
+    if (m_end - m_pos < 4) {
+        return false;
+    }
+    ushort value = 0;
+    for (int i = 0; i < 4; ++i) {
+        const char c = *m_pos++;
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    *out = value;
+    return true;
+}
+
+bool JsonReader::readString(QString* out)
+{
+    if (!consume('"')) {
+        return false;
+    }
+
+    QString result;
+    const char* chunk = m_pos;
+    while (m_pos != m_end) {
+        const char c = *m_pos;
+        if (c == '"') {
+            if (result.isEmpty()) {
+                //Common case: no escape sequences, convert in one go
+                *out = QString::fromUtf8(chunk, int(m_pos - chunk));
+            } else {
+                result += QString::fromUtf8(chunk, int(m_pos - chunk));
+                *out = result;
+            }
+            ++m_pos;
+            return true;
+        }
+        if (uchar(c) < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            ++m_pos;
             continue;
         }
 
-        QMetaProperty property = T::staticMetaObject.property(propertyIndex);
-        bool ret = property.writeOnGadget(object, *iter);
-        if (!ret) {
-            qCWarning(KDECONNECT_CORE) << "couldn't set" << object << "->" << property.name() << '=' << *iter;
+        result += QString::fromUtf8(chunk, int(m_pos - chunk));
+        ++m_pos;
+        if (m_pos == m_end) {
+            return false;
+        }
+        switch (*m_pos++) {
+            case '"': result += QLatin1Char('"'); break;
+            case '\\': result += QLatin1Char('\\'); break;
+            case '/': result += QLatin1Char('/'); break;
+            case 'b': result += QLatin1Char('\b'); break;
+            case 'f': result += QLatin1Char('\f'); break;
+            case 'n': result += QLatin1Char('\n'); break;
+            case 'r': result += QLatin1Char('\r'); break;
+            case 't': result += QLatin1Char('\t'); break;
+            case 'u': {
+                //Surrogate pairs come as two consecutive escapes, appending both code units rebuilds them
+                ushort codeUnit;
+                if (!readHex4(&codeUnit)) {
+                    return false;
+                }
+                result += QChar(codeUnit);
+                break;
+            }
+            default:
+                return false;
+        }
+        chunk = m_pos;
+    }
+    return false;
+}
+
+bool JsonReader::readNumberToken(QByteArray* out)
+{
+    skipWhitespace();
+    const char* start = m_pos;
+    while (m_pos != m_end) {
+        const char c = *m_pos;
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            ++m_pos;
+        } else {
+            break;
+        }
+    }
+    if (m_pos == start) {
+        return false;
+    }
+    *out = QByteArray(start, int(m_pos - start));
+    return true;
+}
+
+bool JsonReader::readNumber(QVariant* out)
+{
+    const char* start = m_pos;
+    bool isInteger = true;
+    while (m_pos != m_end) {
+        const char c = *m_pos;
+        if (c >= '0' && c <= '9') {
+            ++m_pos;
+        } else if (c == '-' && m_pos == start) {
+            ++m_pos;
+        } else if (c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+') {
+            isInteger = false;
+            ++m_pos;
+        } else {
+            break;
+        }
+    }
+
+    const int length = int(m_pos - start);
+    if (length == 0 || (length == 1 && *start == '-')) {
+        return false;
+    }
+
+    //fromRawData avoids a copy, the conversion functions use the C locale
+    const QByteArray token = QByteArray::fromRawData(start, length);
+    bool ok = false;
+    if (isInteger) {
+        const qlonglong value = token.toLongLong(&ok);
+        if (ok) {
+            *out = value;
+            return true;
+        }
+    }
+    const double value = token.toDouble(&ok);
+    if (ok) {
+        *out = value;
+    }
+    return ok;
+}
+
+bool JsonReader::readValue(QVariant* out, int depth)
+{
+    skipWhitespace();
+    if (m_pos == m_end) {
+        return false;
+    }
+
+    switch (*m_pos) {
+        case '{': {
+            QVariantMap map;
+            if (!readObject(&map, depth + 1)) {
+                return false;
+            }
+            *out = map;
+            return true;
+        }
+        case '[': {
+            QVariantList list;
+            if (!readList(&list, depth + 1)) {
+                return false;
+            }
+            *out = list;
+            return true;
+        }
+        case '"': {
+            QString string;
+            if (!readString(&string)) {
+                return false;
+            }
+            *out = string;
+            return true;
+        }
+        case 't':
+            if (!readLiteral("true", 4)) {
+                return false;
+            }
+            *out = true;
+            return true;
+        case 'f':
+            if (!readLiteral("false", 5)) {
+                return false;
+            }
+            *out = false;
+            return true;
+        case 'n':
+            if (!readLiteral("null", 4)) {
+                return false;
+            }
+            *out = QVariant();
+            return true;
+        default:
+            return readNumber(out);
+    }
+}
+
+bool JsonReader::readObject(QVariantMap* out, int depth)
+{
+    if (depth > s_maxDepth || !consume('{')) {
+        return false;
+    }
+    if (consume('}')) {
+        return true;
+    }
+    do {
+        QString key;
+        if (!readString(&key) || !consume(':')) {
+            return false;
+        }
+        QVariant value;
+        if (!readValue(&value, depth)) {
+            return false;
+        }
+        out->insert(key, value);
+    } while (consume(','));
+    return consume('}');
+}
+
+bool JsonReader::skipString()
+{
+    if (!consume('"')) {
+        return false;
+    }
+    while (m_pos != m_end) {
+        const char c = *m_pos++;
+        if (c == '"') {
+            return true;
+        }
+        if (uchar(c) < 0x20) {
+            return false;
+        }
+        if (c == '\\') {
+            if (m_pos == m_end) {
+                return false;
+            }
+            switch (*m_pos++) {
+                case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                    break;
+                case 'u': {
+                    ushort codeUnit;
+                    if (!readHex4(&codeUnit)) {
+                        return false;
+                    }
+                    break;
+                }
+                default:
+                    return false;
+            }
         }
     }
+    return false;
 }
 
-bool NetworkPacket::unserialize(const QByteArray& a, NetworkPacket* np)
+bool JsonReader::skipValue(int depth)
 {
-    //Json -> QVariant
-    QJsonParseError parseError;
-    auto parser = QJsonDocument::fromJson(a, &parseError);
-    if (parser.isNull()) {
+    //Validates the value as thoroughly as readValue() does, without building anything
+    skipWhitespace();
+    if (m_pos == m_end) {
+        return false;
+    }
+
+    switch (*m_pos) {
+        case '{':
+            if (depth + 1 > s_maxDepth || !consume('{')) {
+                return false;
+            }
+            if (consume('}')) {
+                return true;
+            }
+            do {
+                if (!skipString() || !consume(':') || !skipValue(depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume('}');
+        case '[':
+            if (depth + 1 > s_maxDepth || !consume('[')) {
+                return false;
+            }
+            if (consume(']')) {
+                return true;
+            }
+            do {
+                if (!skipValue(depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(']');
+        case '"':
+            return skipString();
+        case 't':
+            return readLiteral("true", 4);
+        case 'f':
+            return readLiteral("false", 5);
+        case 'n':
+            return readLiteral("null", 4);
+        default: {
+            QVariant ignored;
+            return readNumber(&ignored);
+        }
+    }
+}
+
+bool JsonReader::indexObject(QHash<QString, QPair<int, int>>* out)
+{
+    skipWhitespace();
+    const char* start = m_pos;
+    if (!consume('{')) {
+        return false;
+    }
+    if (consume('}')) {
+        return true;
+    }
+    do {
+        QString key;
+        if (!readString(&key) || !consume(':')) {
+            return false;
+        }
+        skipWhitespace();
+        const char* valueStart = m_pos;
+        if (!skipValue(1)) {
+            return false;
+        }
+        out->insert(key, qMakePair(int(valueStart - start), int(m_pos - valueStart)));
+    } while (consume(','));
+    return consume('}');
+}
+
+bool JsonReader::readList(QVariantList* out, int depth)
+{
+    if (depth > s_maxDepth || !consume('[')) {
+        return false;
+    }
+    if (consume(']')) {
+        return true;
+    }
+    do {
+        QVariant value;
+        if (!readValue(&value, depth)) {
+            return false;
+        }
+        out->append(value);
+    } while (consume(','));
+    return consume(']');
+}
+
+}
+
+bool NetworkPacket::unserializeJson(const QByteArray& a, NetworkPacket* np, BodyDecoding decoding)
+{
+    //Json -> NetworkPacket, in a single pass. Nothing is written to np until the whole line parsed fine.
+    JsonReader reader(a);
+    QString id, type;
+    QVariantMap body, payloadTransferInfo;
+    QByteArray lazyBody;
+    QHash<QString, QPair<int, int>> lazyIndex;
+    bool hasId = false, hasType = false, hasBody = false;
+    qint64 payloadSize = 0;
+
+    bool success = reader.consume('{');
+    if (success && !reader.consume('}')) {
+        do {
+            QString key;
+            if (!reader.readString(&key) || !reader.consume(':')) {
+                success = false;
+                break;
+            }
+
+            if (key == QLatin1String("id")) {
+                //Some clients send the id as a number, keep its exact digits
+                hasId = true;
+                if (reader.peek('"')) {
+                    success = reader.readString(&id);
+                } else {
+                    QByteArray token;
+                    success = reader.readNumberToken(&token);
+                    id = QString::fromLatin1(token);
+                }
+            } else if (key == QLatin1String("type")) {
+                hasType = true;
+                success = reader.readString(&type);
+            } else if (key == QLatin1String("body")) {
+                hasBody = true;
+                if (decoding == LazyBody) {
+                    const char* bodyStart = reader.position();
+                    success = reader.indexObject(&lazyIndex);
+                    //mid() makes a deep copy, a might only be a view on the socket buffer
+                    lazyBody = a.mid(int(bodyStart - a.constData()), int(reader.position() - bodyStart));
+                } else {
+                    success = reader.readObject(&body);
+                }
+            } else if (key == QLatin1String("payloadSize")) {
+                QVariant value;
+                success = reader.readValue(&value);
+                payloadSize = value.toLongLong();
+            } else if (key == QLatin1String("payloadTransferInfo")) {
+                success = reader.readObject(&payloadTransferInfo);
+            } else {
+                QVariant ignored;
+                success = reader.readValue(&ignored);
+                qCWarning(KDECONNECT_CORE) << "missing property" << key;
+            }
+        } while (success && reader.consume(','));
+        success = success && reader.consume('}');
+    }
+
+    if (!success || !reader.atEnd()) {
+        qCDebug(KDECONNECT_CORE) << "Unserialization error at offset" << (reader.position() - a.constData());
+        return false;
+    }
+
+    if (hasId) {
+        np->m_id = id;
+    }
+    if (hasType) {
+        np->m_type = type;
+    }
+    if (hasBody) {
+        np->m_body = body;
+        np->m_lazyIndex = lazyIndex;
+        np->m_lazyBody = lazyIndex.isEmpty()? QByteArray() : lazyBody;
+    }
+
+    np->m_payloadSize = payloadSize; //Will be 0 if was not present, which is ok
+    np->m_payloadTransferInfo = payloadTransferInfo; //Will be an empty qvariantmap if was not present, which is ok
+    return true;
+}
+
+bool NetworkPacket::unserializeCbor(const QByteArray& a, NetworkPacket* np)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    if (binaryFrameSize(a.constData(), a.size()) != a.size()) {
+        qCDebug(KDECONNECT_CORE) << "Unserialization error: truncated CBOR frame";
+        return false;
+    }
+
+    QCborParserError parseError;
+    const QCborValue value = QCborValue::fromCbor(a.constData() + s_frameHeaderSize, a.size() - s_frameHeaderSize, &parseError);
+    if (parseError.error != QCborError::NoError || !value.isMap()) {
         qCDebug(KDECONNECT_CORE) << "Unserialization error:" << parseError.errorString();
         return false;
     }
 
-    auto variant = parser.toVariant().toMap();
-    qvariant2qobject(variant, np);
+    const QCborMap map = value.toMap();
+    np->m_id = map.value(QStringLiteral("id")).toVariant().toString();
+    np->m_type = map.value(QStringLiteral("type")).toString();
+    np->setBody(map.value(QStringLiteral("body")).toMap().toVariantMap());
+    np->m_payloadSize = map.value(QStringLiteral("payloadSize")).toInteger();
+    np->m_payloadTransferInfo = map.value(QStringLiteral("payloadTransferInfo")).toMap().toVariantMap();
+    return true;
+#else
+    Q_UNUSED(a);
+    Q_UNUSED(np);
+    qCDebug(KDECONNECT_CORE) << "Unserialization error: CBOR packets are not supported by this build";
+    return false;
+#endif
+}
+
+bool NetworkPacket::unserialize(const QByteArray& a, NetworkPacket* np, BodyDecoding decoding)
+{
+    //CBOR bodies are always decoded upfront, QCborValue doesn't let us keep a cheap reference to the raw bytes
+    const bool isCbor = !a.isEmpty() && a.at(0) == s_cborFrameMarker;
+    if (!(isCbor? unserializeCbor(a, np) : unserializeJson(a, np, decoding))) {
+        return false;
+    }
 
-    np->m_payloadSize = variant[QStringLiteral("payloadSize")].toInt(); //Will return 0 if was not present, which is ok
     if (np->m_payloadSize == -1) {
         np->m_payloadSize = np->get<int>(QStringLiteral("size"), -1);
     }
-    np->m_payloadTransferInfo = variant[QStringLiteral("payloadTransferInfo")].toMap(); //Will return an empty qvariantmap if was not present, which is ok
 
     //Ids containing characters that are not allowed as dbus paths would make app crash
-    if (np->m_body.contains(QStringLiteral("deviceId")))
+    if (np->has(QStringLiteral("deviceId")))
     {
         QString deviceId = np->get<QString>(QStringLiteral("deviceId"));
         DbusHelper::filterNonExportableCharacters(deviceId);
@@ -165,8 +754,41 @@ bool NetworkPacket::unserialize(const QByteArray& a, NetworkPacket* np)
 
 }
 
+void NetworkPacket::decodeLazyValueSlow(const QString& key) const
+{
+    const auto it = m_lazyIndex.constFind(key);
+    if (it == m_lazyIndex.constEnd()) {
+        return;
+    }
+
+    //The value was already validated when the body was indexed
+    const char* value = m_lazyBody.constData() + it->first;
+    JsonReader reader(value, value + it->second);
+    QVariant decoded;
+    reader.readValue(&decoded, 1);
+    m_body.insert(key, decoded);
+
+    m_lazyIndex.erase(it);
+    if (m_lazyIndex.isEmpty()) {
+        m_lazyBody.clear();
+    }
+}
+
+void NetworkPacket::decodeLazyBody() const
+{
+    while (!m_lazyIndex.isEmpty()) {
+        const QString key = m_lazyIndex.constBegin().key();
+        decodeLazyValueSlow(key);
+    }
+}
+
 FileTransferJob* NetworkPacket::createPayloadTransferJob(const QUrl& destination) const
 {
     return new FileTransferJob(payload(), payloadSize(), destination);
 }
 
+QByteArray NetworkPacket::payloadResumeChecksum(const QByteArray& prefixTail)
+{
+    return QCryptographicHash::hash(prefixTail.right(int(s_resumeCheckSize)), QCryptographicHash::Sha1);
+}
+
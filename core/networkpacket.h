@@ -26,6 +26,8 @@
 #include <QObject>
 #include <QString>
 #include <QVariant>
+#include <QHash>
+#include <QPair>
 #include <QIODevice>
 //#include <QtCrypto>
 #include <QSharedPointer>
@@ -49,24 +51,48 @@ public:
     //const static QCA::EncryptionAlgorithm EncryptionAlgorithm;
     const static int s_protocolVersion;
 
+    //JSON packets are sent as lines, CBOR packets as a marker byte followed by a big endian 32 bit length
+    enum WireFormat { JsonFormat, CborFormat };
+    const static char s_cborFrameMarker = 0x01;
+    const static int s_frameHeaderSize = 5;
+    //Links that negotiated payload streams also carry these frames, with the same header
+    const static char s_streamDataMarker = 0x02;
+    const static char s_streamWindowMarker = 0x03;
+    const static char s_streamCloseMarker = 0x04;
+    //And these if they negotiated heartbeats
+    const static char s_heartbeatPingMarker = 0x05;
+    const static char s_heartbeatPongMarker = 0x06;
+    static bool isFrameMarker(char c) { return c >= s_cborFrameMarker && c <= s_heartbeatPongMarker; }
+
     explicit NetworkPacket(const QString& type, const QVariantMap& body = {});
 
-    static void createIdentityPacket(NetworkPacket*);
+    //linkCapabilities are those of the link it will be sent through (see LinkProvider::linkCapabilities)
+    static void createIdentityPacket(NetworkPacket*, const QStringList& linkCapabilities = QStringList());
+
+    //Every link level feature this build knows, each provider tells which of them its links implement
+    static QStringList linkCapabilities();
+
+    //With LazyBody, JSON body members are only decoded when they are accessed for the first time
+    enum BodyDecoding { EagerBody, LazyBody };
+
+    QByteArray serialize(WireFormat format = JsonFormat) const;
+    static bool unserialize(const QByteArray& data, NetworkPacket* out, BodyDecoding decoding = EagerBody);
 
-    QByteArray serialize() const;
-    static bool unserialize(const QByteArray& json, NetworkPacket* out);
+    //Size of the frame starting at data (header included), or -1 if data doesn't contain the whole header yet
+    static qint64 binaryFrameSize(const char* data, qint64 available);
 
     const QString& id() const { return m_id; }
     const QString& type() const { return m_type; }
-    QVariantMap& body() { return m_body; }
-    const QVariantMap& body() const { return m_body; }
+    QVariantMap& body() { decodeLazyBody(); return m_body; }
+    const QVariantMap& body() const { decodeLazyBody(); return m_body; }
 
     //Get and set info from body. Note that id and type can not be accessed through these.
     template<typename T> T get(const QString& key, const T& defaultValue = {}) const {
+        decodeLazyValue(key);
         return m_body.value(key,defaultValue).template value<T>(); //Important note: Awesome template syntax is awesome
     }
-    template<typename T> void set(const QString& key, const T& value) { m_body[key] = QVariant(value); }
-    bool has(const QString& key) const { return m_body.contains(key); }
+    template<typename T> void set(const QString& key, const T& value) { m_lazyIndex.remove(key); m_body[key] = QVariant(value); }
+    bool has(const QString& key) const { return m_body.contains(key) || m_lazyIndex.contains(key); }
 
     QSharedPointer<QIODevice> payload() const { return m_payload; }
     void setPayload(const QSharedPointer<QIODevice>& device, qint64 payloadSize) { m_payload = device; m_payloadSize = payloadSize; Q_ASSERT(m_payloadSize >= -1); }
@@ -74,6 +100,11 @@ public:
     qint64 payloadSize() const { return m_payloadSize; } //-1 means it is an endless stream
     FileTransferJob* createPayloadTransferJob(const QUrl& destination) const;
 
+    //An interrupted payload can continue from an offset if the bytes right before it are the same on both ends,
+    //which the receiver proves with the checksum of (up to) the last s_resumeCheckSize bytes it has
+    const static qint64 s_resumeCheckSize = 64 * 1024;
+    static QByteArray payloadResumeChecksum(const QByteArray& prefixTail);
+
     //To be called by a particular DeviceLink
     QVariantMap payloadTransferInfo() const { return m_payloadTransferInfo; }
     void setPayloadTransferInfo(const QVariantMap& map) { m_payloadTransferInfo = map; }
@@ -81,14 +112,25 @@ public:
 
 private:
 
+    static bool unserializeJson(const QByteArray& json, NetworkPacket* out, BodyDecoding decoding);
+    static bool unserializeCbor(const QByteArray& frame, NetworkPacket* out);
+
+    void decodeLazyValue(const QString& key) const { if (!m_lazyIndex.isEmpty()) decodeLazyValueSlow(key); }
+    void decodeLazyValueSlow(const QString& key) const;
+    void decodeLazyBody() const;
+
     void setId(const QString& id) { m_id = id; }
     void setType(const QString& t) { m_type = t; }
-    void setBody(const QVariantMap& b) { m_body = b; }
+    void setBody(const QVariantMap& b) { m_lazyIndex.clear(); m_lazyBody.clear(); m_body = b; }
     void setPayloadSize(qint64 s) { m_payloadSize = s; }
 
     QString m_id;
     QString m_type;
-    QVariantMap m_body;
+    mutable QVariantMap m_body;
+
+    //Body members not decoded yet: raw JSON of the body and the offset and length of each member's value in it
+    mutable QByteArray m_lazyBody;
+    mutable QHash<QString, QPair<int, int>> m_lazyIndex;
 	
     QSharedPointer<QIODevice> m_payload;
     qint64 m_payloadSize;
@@ -24,4 +24,11 @@
 #define PACKET_TYPE_IDENTITY QStringLiteral("kdeconnect.identity")
 #define PACKET_TYPE_PAIR QStringLiteral("kdeconnect.pair")
 
+#define LINK_CAPABILITY_CBOR QStringLiteral("cbor")
+#define LINK_CAPABILITY_PAYLOAD_STREAMS QStringLiteral("payloadstreams")
+#define LINK_CAPABILITY_PAYLOAD_TOKENS QStringLiteral("payloadtokens")
+#define LINK_CAPABILITY_PAYLOAD_RANGES QStringLiteral("payloadranges")
+#define LINK_CAPABILITY_PAYLOAD_CHECKSUMS QStringLiteral("payloadchecksums")
+#define LINK_CAPABILITY_HEARTBEAT QStringLiteral("heartbeat")
+
 #endif // NETWORKPACKETTYPES_H
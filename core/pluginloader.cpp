@@ -37,9 +37,16 @@ PluginLoader* PluginLoader::instance()
 PluginLoader::PluginLoader()
 {
     const QVector<KPluginMetaData> data = KPluginLoader::findPlugins(QStringLiteral("kdeconnect/"));
+    QSet<QString> incoming, outgoing;
     for (const KPluginMetaData& metadata : data) {
         plugins[metadata.pluginId()] = metadata;
+        incoming += KPluginMetaData::readStringList(metadata.rawData(), QStringLiteral("X-KdeConnect-SupportedPacketType")).toSet();
+        outgoing += KPluginMetaData::readStringList(metadata.rawData(), QStringLiteral("X-KdeConnect-OutgoingPacketType")).toSet();
+        m_supersedablePacketTypes += KPluginMetaData::readStringList(metadata.rawData(), QStringLiteral("X-KdeConnect-SupersedablePacketType")).toSet();
+        m_bulkPacketTypes += KPluginMetaData::readStringList(metadata.rawData(), QStringLiteral("X-KdeConnect-BulkPacketType")).toSet();
     }
+    m_incomingCapabilities = incoming.toList();
+    m_outgoingCapabilities = outgoing.toList();
 }
 
 QStringList PluginLoader::getPluginList() const
@@ -85,20 +92,12 @@ KdeConnectPlugin* PluginLoader::instantiatePluginForDevice(const QString& plugin
 
 QStringList PluginLoader::incomingCapabilities() const
 {
-    QSet<QString> ret;
-    for (const KPluginMetaData& service : qAsConst(plugins)) {
-        ret += KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-SupportedPacketType")).toSet();
-    }
-    return ret.toList();
+    return m_incomingCapabilities;
 }
 
 QStringList PluginLoader::outgoingCapabilities() const
 {
-    QSet<QString> ret;
-    for (const KPluginMetaData& service : qAsConst(plugins)) {
-        ret += KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-OutgoingPacketType")).toSet();
-    }
-    return ret.toList();
+    return m_outgoingCapabilities;
 }
 
 QSet<QString> PluginLoader::pluginsForCapabilities(const QSet<QString>& incoming, const QSet<QString>& outgoing)
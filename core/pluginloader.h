@@ -44,10 +44,21 @@ public:
     QStringList outgoingCapabilities() const;
     QSet<QString> pluginsForCapabilities(const QSet<QString>& incoming, const QSet<QString>& outgoing);
 
+    //Outgoing packet types for which only the newest packet matters, so queued ones can be replaced by it
+    bool isSupersedable(const QString& packetType) const { return m_supersedablePacketTypes.contains(packetType); }
+    //Outgoing packet types that are big and not urgent, so they are sent after interactive ones
+    bool isBulkPacketType(const QString& packetType) const { return m_bulkPacketTypes.contains(packetType); }
+
 private:
     PluginLoader();
     QHash<QString, KPluginMetaData> plugins;
 
+    //Plugins are only looked up once, so these never change after the constructor
+    QStringList m_incomingCapabilities;
+    QStringList m_outgoingCapabilities;
+    QSet<QString> m_supersedablePacketTypes;
+    QSet<QString> m_bulkPacketTypes;
+
 
 };
 
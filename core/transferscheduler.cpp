@@ -0,0 +1,150 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "transferscheduler.h"
+
+#include <QPointer>
+#include <QTimer>
+
+#include "core_debug.h"
+
+const qint64 TransferScheduler::s_smallPayloadSize;
+const int TransferScheduler::s_maxSmallTransfers;
+const int TransferScheduler::s_maxBulkTransfers;
+const int TransferScheduler::s_startTimeout;
+
+TransferScheduler::TransferScheduler(QObject* parent)
+    : QObject(parent)
+    , m_startTimeout(s_startTimeout)
+{
+}
+
+void TransferScheduler::enqueueUpload(const NetworkPacket& np)
+{
+    enqueue({np, QWeakPointer<QIODevice>()}, np.payloadSize());
+}
+
+void TransferScheduler::enqueueDownload(const QSharedPointer<QIODevice>& payload, qint64 size)
+{
+    enqueue({NetworkPacket(QString()), payload.toWeakRef()}, size);
+}
+
+bool TransferScheduler::needsScheduling(const QIODevice* payload)
+{
+    //Other payloads come through the connection of the link
+    return qobject_cast<const ScheduledPayload*>(payload) != nullptr;
+}
+
+void TransferScheduler::enqueue(const Transfer& transfer, qint64 size)
+{
+    if (size >= 0 && size <= s_smallPayloadSize) {
+        m_queuedSmall.append(transfer);
+    } else {
+        m_queuedBulk.append(transfer);
+    }
+    startNext();
+    Q_EMIT transfersChanged(activeTransfers(), queuedTransfers());
+}
+
+void TransferScheduler::startNext()
+{
+    //Small payloads can also take the slots bulk ones are not using, but not the other way around
+    while (!m_queuedSmall.isEmpty() && m_activeSmall.size() < s_maxSmallTransfers) {
+        start(m_queuedSmall.takeFirst(), m_activeSmall);
+    }
+    while (!m_queuedSmall.isEmpty() && m_activeBulk.size() < s_maxBulkTransfers) {
+        start(m_queuedSmall.takeFirst(), m_activeBulk);
+    }
+    while (!m_queuedBulk.isEmpty() && m_activeBulk.size() < s_maxBulkTransfers) {
+        start(m_queuedBulk.takeFirst(), m_activeBulk);
+    }
+}
+
+void TransferScheduler::start(const Transfer& transfer, QSet<QObject*>& active)
+{
+    const bool upload = transfer.packet.hasPayload();
+    const QSharedPointer<QIODevice> payload = upload? transfer.packet.payload() : transfer.download.toStrongRef();
+    if (!payload) {
+        return; //Dropped while it was queued
+    }
+
+    active.insert(payload.data());
+    connect(payload.data(), &QIODevice::aboutToClose, this, &TransferScheduler::transferEnded);
+    connect(payload.data(), &QIODevice::readChannelFinished, this, &TransferScheduler::transferEnded);
+    connect(payload.data(), &QObject::destroyed, this, &TransferScheduler::payloadDestroyed);
+
+    if (upload) {
+        QPointer<QIODevice> started = payload.data();
+        QTimer::singleShot(m_startTimeout, this, [this, started]() {
+            if (started) {
+                uploadStartTimedOut(started.data());
+            }
+        });
+        Q_EMIT uploadReady(transfer.packet);
+    } else {
+        //needsScheduling() told apart the downloads that get here
+        static_cast<ScheduledPayload*>(payload.data())->start();
+    }
+}
+
+void TransferScheduler::uploadStarted(QIODevice* payload)
+{
+    if (m_activeSmall.contains(payload) || m_activeBulk.contains(payload)) {
+        m_startedUploads.insert(payload);
+    }
+}
+
+void TransferScheduler::uploadStartTimedOut(QIODevice* payload)
+{
+    //Being open doesn't tell, some payloads (eg: icons in a QBuffer) come open already
+    if (!m_startedUploads.contains(payload) && (m_activeSmall.contains(payload) || m_activeBulk.contains(payload))) {
+        qCDebug(KDECONNECT_CORE) << "Payload not requested after" << m_startTimeout << "ms, starting the next transfer";
+        release(payload);
+    }
+}
+
+void TransferScheduler::transferEnded()
+{
+    releaseSlot(sender(), false);
+}
+
+void TransferScheduler::payloadDestroyed(QObject* payload)
+{
+    releaseSlot(payload, true);
+}
+
+void TransferScheduler::release(QIODevice* payload)
+{
+    releaseSlot(payload, false);
+}
+
+void TransferScheduler::releaseSlot(QObject* payload, bool destroyed)
+{
+    if (!m_activeSmall.remove(payload) && !m_activeBulk.remove(payload)) {
+        return;
+    }
+    m_startedUploads.remove(payload);
+    if (!destroyed) {
+        //A destroyed payload is only used as a key, QObject disconnects it by itself
+        disconnect(payload, nullptr, this, nullptr);
+    }
+    startNext();
+    Q_EMIT transfersChanged(activeTransfers(), queuedTransfers());
+}
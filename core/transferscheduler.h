@@ -0,0 +1,123 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QList>
+#include <QSet>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+#include "kdeconnectcore_export.h"
+#include "networkpacket.h"
+
+/*
+ * A payload that doesn't transfer anything until the scheduler starts it, like the downloads
+ * LAN links create.
+ */
+class KDECONNECTCORE_EXPORT ScheduledPayload
+    : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit ScheduledPayload(QObject* parent = nullptr) : QIODevice(parent) {}
+
+    //Only the first call does anything
+    virtual void start() = 0;
+
+    //To continue a transfer we had started before (eg: into a partial file), called before
+    //start(). prefixTail are the last bytes we have. Payloads that can't resume return false.
+    virtual bool resumeFrom(qint64 offset, const QByteArray& prefixTail) { Q_UNUSED(offset); Q_UNUSED(prefixTail); return false; }
+};
+
+/*
+ * Decides when the payloads of a device are transferred, so sharing hundreds of files doesn't
+ * open hundreds of connections at once.
+ *
+ * Small payloads (notification icons, album art...) and bulk ones have separate limits, so a
+ * few big files never make the small ones wait for them. Each kind goes in arrival order.
+ *
+ * Uploads are packets the device sends once it's their turn (see uploadReady). Downloads are
+ * ScheduledPayload devices, which we start then. A transfer is over when its payload is closed,
+ * finishes reading or is destroyed. Uploads the link doesn't report as started (see
+ * uploadStarted) within the start timeout stop holding a slot, so a peer ignoring a payload
+ * can't block the rest.
+ */
+class KDECONNECTCORE_EXPORT TransferScheduler
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferScheduler(QObject* parent = nullptr);
+
+    void enqueueUpload(const NetworkPacket& np);
+    void enqueueDownload(const QSharedPointer<QIODevice>& payload, qint64 size);
+    static bool needsScheduling(const QIODevice* payload);
+
+    //The peer connected to get the payload of an upload
+    void uploadStarted(QIODevice* payload);
+    //For transfers that couldn't start after all
+    void release(QIODevice* payload);
+
+    void setStartTimeout(int timeout) { m_startTimeout = timeout; }
+
+    int activeTransfers() const { return m_activeSmall.size() + m_activeBulk.size(); }
+    int queuedTransfers() const { return m_queuedSmall.size() + m_queuedBulk.size(); }
+
+    const static qint64 s_smallPayloadSize = 1024 * 1024;
+    const static int s_maxSmallTransfers = 3;
+    const static int s_maxBulkTransfers = 3;
+    const static int s_startTimeout = 60000;
+
+Q_SIGNALS:
+    void uploadReady(const NetworkPacket& np);
+    void transfersChanged(int active, int queued);
+
+private Q_SLOTS:
+    void transferEnded();
+    void payloadDestroyed(QObject* payload);
+
+private:
+    struct Transfer {
+        NetworkPacket packet; //Only for uploads, it keeps the payload alive
+        QWeakPointer<QIODevice> download; //Nobody may want it by the time it's its turn
+    };
+
+    void enqueue(const Transfer& transfer, qint64 size);
+    void startNext();
+    void start(const Transfer& transfer, QSet<QObject*>& active);
+    void uploadStartTimedOut(QIODevice* payload);
+    void releaseSlot(QObject* payload, bool destroyed);
+
+    QList<Transfer> m_queuedSmall;
+    QList<Transfer> m_queuedBulk;
+    //Keyed by QObject, the destroyed signal comes when only that part of the payload is left
+    QSet<QObject*> m_activeSmall;
+    QSet<QObject*> m_activeBulk;
+    QSet<QObject*> m_startedUploads;
+    int m_startTimeout;
+};
+
+#endif
@@ -20,7 +20,10 @@
 
 #include "../core/device.h"
 #include "../core/backends/lan/lanlinkprovider.h"
+#include "../core/backends/loopback/loopbacklinkprovider.h"
+#include "../core/backends/lan/server.h"
 #include "../core/kdeconnectconfig.h"
+#include "../core/pluginloader.h"
 
 #include <QtTest>
 
@@ -36,6 +39,10 @@ private Q_SLOTS:
     void initTestCase();
     void testUnpairedDevice();
     void testPairedDevice();
+    void testSendQueue();
+    void testSendQueueNewConnection();
+    void testPacketDispatchBenchmark_data();
+    void testPacketDispatchBenchmark();
     void cleanupTestCase();
 
 private:
@@ -48,6 +55,8 @@ private:
 
 void DeviceTest::initTestCase()
 {
+    QStandardPaths::setTestModeEnabled(true);
+
     deviceId = QStringLiteral("testdevice");
     deviceName = QStringLiteral("Test Device");
     deviceType = QStringLiteral("smartphone");
@@ -116,6 +125,231 @@ void DeviceTest::testUnpairedDevice()
     QCOMPARE(device.availableLinks().contains(linkProvider.name()), false);
 }
 
+void DeviceTest::testSendQueue()
+{
+    Server server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    QSslSocket* socket = new QSslSocket();
+    socket->connectToHost(QHostAddress::LocalHost, server.serverPort());
+    QVERIFY(socket->waitForConnected());
+    QVERIFY(server.hasPendingConnections() || server.waitForNewConnection(5000));
+    QSslSocket* peer = server.nextPendingConnection();
+    QVERIFY(peer);
+
+    LanLinkProvider linkProvider;
+    LanDeviceLink link(deviceId, &linkProvider, socket, LanDeviceLink::Locally);
+
+    //Without going back to the event loop nothing leaves the socket, so it looks like a stalled peer
+    const int packetCount = 100;
+    const QString filler(8 * 1024, QLatin1Char('x'));
+    for (int i = 0; i < packetCount; ++i) {
+        NetworkPacket np(QStringLiteral("kdeconnect.test"));
+        np.set(QStringLiteral("filler"), filler);
+        QVERIFY(link.sendPacket(np));
+    }
+    QVERIFY(link.queuedPackets() > 0);
+    QVERIFY(socket->bytesToWrite() < LanDeviceLink::s_highWatermark + filler.size() * 2);
+    //Everything is interactive, a heartbeat would wait for all of it
+    QCOMPARE(link.interactiveBacklog(), link.queuedBytes() + socket->bytesToWrite());
+
+    int expectedCount = packetCount;
+    if (PluginLoader::instance()->isSupersedable(QStringLiteral("kdeconnect.clipboard"))) {
+        //Only the newest of these is worth sending
+        const int queued = link.queuedPackets();
+        for (int i = 0; i < 5; ++i) {
+            NetworkPacket np(QStringLiteral("kdeconnect.clipboard"));
+            np.set(QStringLiteral("content"), QString::number(i));
+            QVERIFY(link.sendPacket(np));
+        }
+        QCOMPARE(link.queuedPackets(), queued + 1);
+        expectedCount++;
+
+        //Replacing it doesn't get around the size limit of the queues
+        NetworkPacket huge(QStringLiteral("kdeconnect.clipboard"));
+        huge.set(QStringLiteral("content"), QString(int(DeviceLink::s_maxQueuedBytes), QLatin1Char('c')));
+        const qint64 queuedBytes = link.queuedBytes();
+        QVERIFY(!link.sendPacket(huge));
+        QCOMPARE(link.queuedBytes(), queuedBytes);
+        QCOMPARE(link.queuedPackets(), queued + 1);
+    }
+
+    const bool testLanes = PluginLoader::instance()->isBulkPacketType(QStringLiteral("kdeconnect.runcommand"));
+    if (testLanes) {
+        //Interactive packets overtake bulk ones queued before them
+        NetworkPacket bulk(QStringLiteral("kdeconnect.runcommand"));
+        bulk.set(QStringLiteral("commandList"), QString(100 * 1024, QLatin1Char('y')));
+        QVERIFY(link.sendPacket(bulk));
+        NetworkPacket interactive(QStringLiteral("kdeconnect.mousepad.request"));
+        interactive.set(QStringLiteral("dx"), 1);
+        QVERIFY(link.sendPacket(interactive));
+        expectedCount += 2;
+    }
+
+    //Once the peer reads, the queue drains and everything arrives in order
+    QByteArray received;
+    QElapsedTimer timer;
+    timer.start();
+    while (received.count('\n') < expectedCount && timer.elapsed() < 10000) {
+        if (peer->waitForReadyRead(100)) {
+            received += peer->readAll();
+        }
+        QCoreApplication::processEvents();
+    }
+    QCOMPARE(received.count('\n'), expectedCount);
+    if (testLanes) {
+        QVERIFY(received.indexOf("kdeconnect.mousepad.request") < received.indexOf("kdeconnect.runcommand"));
+    }
+    QCOMPARE(link.queuedPackets(), 0);
+    QCOMPARE(link.queuedBytes(), qint64(0));
+
+    if (testLanes) {
+        //A bulk packet being written is still queued, but only once
+        NetworkPacket bulk(QStringLiteral("kdeconnect.runcommand"));
+        bulk.set(QStringLiteral("commandList"), QString(100 * 1024, QLatin1Char('z')));
+        QVERIFY(link.sendPacket(bulk));
+        QVERIFY(socket->bytesToWrite() > 0);
+        QVERIFY(link.queuedBytes() > 0);
+        QCOMPARE(link.queuedPackets(), 1);
+
+        received.clear();
+        timer.start();
+        while (!received.contains('\n') && timer.elapsed() < 10000) {
+            if (peer->waitForReadyRead(100)) {
+                received += peer->readAll();
+            }
+            QCoreApplication::processEvents();
+        }
+        QCOMPARE(received.count('\n'), 1);
+        QCOMPARE(link.queuedPackets(), 0);
+    }
+}
+
+void DeviceTest::testSendQueueNewConnection()
+{
+    if (!PluginLoader::instance()->isBulkPacketType(QStringLiteral("kdeconnect.runcommand"))) {
+        QSKIP("Needs the runcommand plugin, whose packets are bulk ones");
+    }
+
+    Server server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    auto connectSocket = [&server](QSslSocket* socket) -> QSslSocket* {
+        socket->connectToHost(QHostAddress::LocalHost, server.serverPort());
+        if (!socket->waitForConnected() || (!server.hasPendingConnections() && !server.waitForNewConnection(5000))) {
+            return nullptr;
+        }
+        return server.nextPendingConnection();
+    };
+
+    QSslSocket* socket = new QSslSocket();
+    QSslSocket* peer = connectSocket(socket);
+    QVERIFY(peer);
+
+    LanLinkProvider linkProvider;
+    LanDeviceLink link(deviceId, &linkProvider, socket, LanDeviceLink::Locally);
+
+    //Without going back to the event loop, only the first slices of it go into the socket
+    NetworkPacket bulk(QStringLiteral("kdeconnect.runcommand"));
+    bulk.set(QStringLiteral("commandList"), QString(100 * 1024, QLatin1Char('y')));
+    QVERIFY(link.sendPacket(bulk));
+    QVERIFY(socket->bytesToWrite() > 0);
+    QVERIFY(socket->bytesToWrite() < 100 * 1024);
+    QCOMPARE(link.queuedPackets(), 1);
+
+    //The connection is replaced in the middle of the packet, the new one gets all of it
+    QSslSocket* newSocket = new QSslSocket();
+    QSslSocket* newPeer = connectSocket(newSocket);
+    QVERIFY(newPeer);
+    link.reset(newSocket, LanDeviceLink::Locally);
+
+    QByteArray received;
+    QElapsedTimer timer;
+    timer.start();
+    while (!received.contains('\n') && timer.elapsed() < 10000) {
+        if (newPeer->waitForReadyRead(100)) {
+            received += newPeer->readAll();
+        }
+        QCoreApplication::processEvents();
+    }
+    QCOMPARE(received.count('\n'), 1);
+
+    NetworkPacket np(QString::null);
+    QVERIFY(NetworkPacket::unserialize(received, &np));
+    QCOMPARE(np.type(), QStringLiteral("kdeconnect.runcommand"));
+    QCOMPARE(np.get<QString>(QStringLiteral("commandList")).size(), 100 * 1024);
+    QCOMPARE(link.queuedPackets(), 0);
+}
+
+void DeviceTest::testPacketDispatchBenchmark_data()
+{
+    QTest::addColumn<int>("otherPlugins");
+    QTest::addColumn<bool>("batched");
+
+    QTest::newRow("1 plugin") << 0 << false;
+    QTest::newRow("6 plugins") << 5 << false;
+    QTest::newRow("all plugins") << INT_MAX << false;
+    QTest::newRow("1 plugin, batches") << 0 << true;
+    QTest::newRow("all plugins, batches") << INT_MAX << true;
+}
+
+void DeviceTest::testPacketDispatchBenchmark()
+{
+    QFETCH(int, otherPlugins);
+    QFETCH(bool, batched);
+
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    kcc->addTrustedDevice(deviceId, deviceName, deviceType);
+    kcc->setDeviceProperty(deviceId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+
+    Device device(this, deviceId);
+    LoopbackLinkProvider linkProvider;
+    LoopbackDeviceLink* link = new LoopbackDeviceLink(deviceId, &linkProvider);
+    device.addLink(*identityPacket, link);
+
+    const QString batteryPlugin = QStringLiteral("kdeconnect_battery");
+    if (!device.supportedPlugins().contains(batteryPlugin)) {
+        QSKIP("kdeconnect_battery is required for this test");
+    }
+
+    //Battery handles the packets we send, the rest are only there to make the dispatch table bigger
+    device.setPluginEnabled(batteryPlugin, true);
+    int enabledOthers = 0;
+    for (const QString& plugin : device.supportedPlugins()) {
+        if (plugin != batteryPlugin) {
+            device.setPluginEnabled(plugin, enabledOthers < otherPlugins);
+            enabledOthers++;
+        }
+    }
+    QVERIFY(device.hasPlugin(batteryPlugin));
+    qDebug() << "Dispatching to a device with" << device.loadedPlugins().size() << "plugins loaded";
+
+    NetworkPacket np(QStringLiteral("kdeconnect.battery"));
+    np.set(QStringLiteral("currentCharge"), 50);
+    np.set(QStringLiteral("isCharging"), true);
+    np.set(QStringLiteral("thresholdEvent"), 0);
+
+    //Emitted straight from the link, so serialization doesn't show up in the results.
+    //Both variants deliver 100 packets per iteration.
+    const QVector<NetworkPacket> batch(100, np);
+    if (batched) {
+        QBENCHMARK {
+            Q_EMIT link->receivedPackets(batch);
+        }
+    } else {
+        QBENCHMARK {
+            for (const NetworkPacket& packet : batch) {
+                Q_EMIT link->receivedPacket(packet);
+            }
+        }
+    }
+
+    for (const QString& plugin : device.supportedPlugins()) {
+        device.setPluginEnabled(plugin, true);
+    }
+    delete link;
+    kcc->removeTrustedDevice(deviceId);
+}
+
 void DeviceTest::cleanupTestCase()
 {
     delete identityPacket;
@@ -24,12 +24,18 @@
 #include "../core/backends/lan/lanlinkprovider.h"
 #include "../core/backends/lan/server.h"
 #include "../core/backends/lan/socketlinereader.h"
+#include "../core/backends/lan/uploadjob.h"
+#include "../core/backends/lan/downloadjob.h"
+#include "../core/backends/lan/rangeddownload.h"
 #include "../core/kdeconnectconfig.h"
 
 #include <QAbstractSocket>
+#include <QBuffer>
+#include <QElapsedTimer>
 #include <QSslSocket>
 #include <QtTest>
 #include <QSslKey>
+#include <QTemporaryFile>
 #include <QUdpSocket>
 
 /*
@@ -55,7 +61,18 @@ private Q_SLOTS:
 
     void unpairedDeviceTcpPacketReceived();
     void unpairedDeviceUdpPacketReceived();
-
+    void repeatedIdentitiesIgnored();
+    void identityFromSeveralAddresses();
+    void knownDeviceConnectedDirectly();
+
+    void identityPacketFollowsName();
+    void discoveryOnEveryInterface();
+    void timeToDiscovery();
+    void payloadThroughSharedPort();
+    void payloadThroughSeveralConnections();
+    void payloadResumedAfterConnectionDrop();
+    void payloadRestartedBeforeAnythingRead();
+    void payloadFileTruncated();
 
 private:
     const int TEST_PORT = 8520;
@@ -299,6 +316,164 @@ void LanLinkProviderTest::unpairedDeviceUdpPacketReceived()
     delete m_udpSocket;
 }
 
+void LanLinkProviderTest::repeatedIdentitiesIgnored()
+{
+    m_server = new Server(this);
+    m_udpSocket = new QUdpSocket(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost, TEST_PORT));
+    QSignalSpy spy(m_server, &Server::newConnection);
+
+    const quint64 rateLimited = m_lanLinkProvider.rateLimitedIdentities();
+    const quint64 duplicated = m_lanLinkProvider.duplicatedIdentities();
+    const quint64 withLiveLink = m_lanLinkProvider.identitiesWithLiveLink();
+
+    //Like a device rebroadcasting its identity in a loop
+    const int sent = LanLinkProvider::s_identityBurst * 2;
+    for (int i = 0; i < sent; ++i) {
+        QCOMPARE(m_udpSocket->writeDatagram(m_identityPacket.toLatin1(), QHostAddress::LocalHost, LanLinkProvider::UDP_PORT), qint64(m_identityPacket.size()));
+    }
+
+    QVERIFY(!spy.isEmpty() || spy.wait());
+    QTest::qWait(500);
+    QCOMPARE(spy.count(), 1);
+
+    const quint64 newRateLimited = m_lanLinkProvider.rateLimitedIdentities() - rateLimited;
+    const quint64 newDuplicated = m_lanLinkProvider.duplicatedIdentities() - duplicated;
+    QVERIFY(newRateLimited >= quint64(sent - LanLinkProvider::s_identityBurst));
+    QVERIFY(newDuplicated > 0);
+    QCOMPARE(newRateLimited + newDuplicated + m_lanLinkProvider.identitiesWithLiveLink() - withLiveLink, quint64(sent - 1));
+
+    delete m_server;
+    delete m_udpSocket;
+}
+
+void LanLinkProviderTest::identityFromSeveralAddresses()
+{
+    m_server = new Server(this);
+    QVERIFY(m_server->listen(QHostAddress::AnyIPv4, TEST_PORT));
+    QSignalSpy spy(m_server, &Server::newConnection);
+    const quint64 duplicated = m_lanLinkProvider.duplicatedIdentities();
+
+    //Like a device with IPv4 and IPv6 answering both of our broadcasts
+    const QByteArray identity = m_identityPacket.toLatin1().replace("\"testdevice\"", "\"dualstackdevice\"");
+    QUdpSocket first, second;
+    QVERIFY(first.bind(QHostAddress(QStringLiteral("127.0.0.2")), 0));
+    QVERIFY(second.bind(QHostAddress(QStringLiteral("127.0.0.3")), 0));
+    QCOMPARE(first.writeDatagram(identity, QHostAddress::LocalHost, LanLinkProvider::UDP_PORT), qint64(identity.size()));
+    QCOMPARE(second.writeDatagram(identity, QHostAddress::LocalHost, LanLinkProvider::UDP_PORT), qint64(identity.size()));
+
+    QVERIFY(!spy.isEmpty() || spy.wait());
+    QTest::qWait(500);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(m_lanLinkProvider.duplicatedIdentities() - duplicated, quint64(1));
+
+    delete m_server;
+}
+
+void LanLinkProviderTest::knownDeviceConnectedDirectly()
+{
+    //Another device, the connections the other tests left behind may still be closing
+    const QString deviceId = QStringLiteral("knowndevice");
+    //Broadcasts in test mode go to 127.0.0.1, only what is sent to the device itself gets here
+    const QHostAddress lastAddress(QStringLiteral("127.0.0.2"));
+
+    QUdpSocket udpServer;
+    if (!udpServer.bind(lastAddress, LanLinkProvider::UDP_PORT, QUdpSocket::ShareAddress)) {
+        QSKIP("Needs 127.0.0.2 to be a local address");
+    }
+    QSignalSpy spy(&udpServer, SIGNAL(readyRead()));
+
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    kcc->addTrustedDevice(deviceId, m_name, QStringLiteral("phone"));
+    kcc->setLastAddress(deviceId, lastAddress);
+    QCOMPARE(kcc->getLastAddress(deviceId), lastAddress);
+
+    //It connects back to us with the identity it has now, we don't assume anything about it
+    QElapsedTimer timer;
+    timer.start();
+    m_lanLinkProvider.onNetworkChange();
+    QVERIFY(!spy.isEmpty() || spy.wait(1000));
+    QVERIFY(timer.elapsed() < 1000);
+
+    QByteArray datagram;
+    datagram.resize(udpServer.pendingDatagramSize());
+    udpServer.readDatagram(datagram.data(), datagram.size());
+    testIdentityPacket(datagram);
+
+    //Forgetting the device forgets where it was
+    kcc->removeTrustedDevice(deviceId);
+    QVERIFY(kcc->getLastAddress(deviceId).isNull());
+}
+
+void LanLinkProviderTest::identityPacketFollowsName()
+{
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    const QString oldName = kcc->name();
+
+    QUdpSocket udpServer;
+    QVERIFY(udpServer.bind(QHostAddress::LocalHost, LanLinkProvider::UDP_PORT, QUdpSocket::ShareAddress));
+    QSignalSpy spy(&udpServer, SIGNAL(readyRead()));
+
+    //The serialized identity is cached, renaming ourselves must still be announced
+    kcc->setName(QStringLiteral("Renamed device"));
+    m_lanLinkProvider.onNetworkChange();
+    QVERIFY(!spy.isEmpty() || spy.wait());
+
+    QByteArray datagram;
+    datagram.resize(udpServer.pendingDatagramSize());
+    udpServer.readDatagram(datagram.data(), datagram.size());
+    testIdentityPacket(datagram);
+
+    QJsonObject body = QJsonDocument::fromJson(datagram).object().value(QStringLiteral("body")).toObject();
+    QCOMPARE(body.value(QStringLiteral("deviceName")).toString(), QStringLiteral("Renamed device"));
+
+    kcc->setName(oldName);
+}
+
+void LanLinkProviderTest::discoveryOnEveryInterface()
+{
+    const QList<QNetworkInterface> interfaces = QNetworkInterface::allInterfaces();
+    const QList<QHostAddress> addresses = LanLinkProvider::discoveryAddresses(interfaces, false);
+
+    for (const QNetworkInterface& iface : interfaces) {
+        if ((iface.flags() & QNetworkInterface::IsLoopback) || !(iface.flags() & QNetworkInterface::IsUp) || !(iface.flags() & QNetworkInterface::IsRunning)) {
+            continue;
+        }
+        for (const QNetworkAddressEntry& entry : iface.addressEntries()) {
+            if (entry.ip().protocol() == QAbstractSocket::IPv4Protocol && !entry.broadcast().isNull()) {
+                QVERIFY2(addresses.contains(entry.broadcast()), qPrintable(iface.name()));
+            }
+        }
+    }
+    for (const QHostAddress& address : addresses) {
+        QVERIFY(!address.isLoopback());
+    }
+
+    //What the tests use instead
+    QVERIFY(LanLinkProvider::discoveryAddresses(interfaces, true).contains(QHostAddress(QHostAddress::LocalHost)));
+}
+
+void LanLinkProviderTest::timeToDiscovery()
+{
+    QUdpSocket udpServer;
+    QVERIFY(udpServer.bind(QHostAddress::LocalHost, LanLinkProvider::UDP_PORT, QUdpSocket::ShareAddress));
+    QSignalSpy spy(&udpServer, SIGNAL(readyRead()));
+
+    QElapsedTimer timer;
+    timer.start();
+    m_lanLinkProvider.onNetworkChange();
+    QVERIFY(!spy.isEmpty() || spy.wait(1000));
+    const qint64 elapsed = timer.elapsed();
+
+    QByteArray datagram;
+    datagram.resize(udpServer.pendingDatagramSize());
+    udpServer.readDatagram(datagram.data(), datagram.size());
+    testIdentityPacket(datagram);
+
+    qDebug() << "Identity received" << elapsed << "ms after the network changed";
+    QVERIFY(elapsed < 1000);
+}
+
 void LanLinkProviderTest::testIdentityPacket(QByteArray& identityPacket)
 {
     QJsonDocument jsonDocument = QJsonDocument::fromJson(identityPacket);
@@ -337,6 +512,261 @@ void LanLinkProviderTest::setSocketAttributes(QSslSocket* socket)
     socket->setLocalCertificate(m_certificate);
 }
 
+void LanLinkProviderTest::payloadThroughSharedPort()
+{
+    //We are both ends of the transfer, so we have to trust ourselves
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    const QString ownId = kcc->deviceId();
+    kcc->addTrustedDevice(ownId, kcc->name(), QStringLiteral("desktop"));
+    kcc->setDeviceProperty(ownId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+    LanLinkProvider::forgetSslState(ownId);
+
+    QVERIFY(m_lanLinkProvider.payloadPort() != 0);
+
+    const QByteArray data(100 * 1024, 'x');
+    QSharedPointer<QBuffer> source(new QBuffer());
+    source->setData(data);
+
+    UploadJob* upload = new UploadJob(source, ownId);
+    const QString token = m_lanLinkProvider.registerUpload(upload);
+    QVERIFY(!token.isEmpty());
+    upload->setTransferToken(m_lanLinkProvider.payloadPort(), token);
+    upload->start();
+
+    QVariantMap transferInfo = upload->transferInfo();
+    QCOMPARE(transferInfo.value(QStringLiteral("port")).toInt(), int(m_lanLinkProvider.payloadPort()));
+    transferInfo.insert(QStringLiteral("deviceId"), ownId);
+
+    DownloadJob* download = new DownloadJob(QHostAddress::LocalHost, transferInfo);
+    QSharedPointer<QIODevice> payload = download->getPayload();
+    download->start();
+
+    QByteArray received;
+    QTRY_VERIFY_WITH_TIMEOUT((received += payload->readAll()).size() == data.size(), 10000);
+    QVERIFY(received == data);
+
+    kcc->removeTrustedDevice(ownId);
+    LanLinkProvider::forgetSslState(ownId);
+}
+
+void LanLinkProviderTest::payloadThroughSeveralConnections()
+{
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    const QString ownId = kcc->deviceId();
+    kcc->addTrustedDevice(ownId, kcc->name(), QStringLiteral("desktop"));
+    kcc->setDeviceProperty(ownId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+    LanLinkProvider::forgetSslState(ownId);
+
+    //Blocks only go out of order if there are several of them per connection
+    QByteArray data(int(UploadJob::s_rangeBlockSize * 8 + 123), Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = char(i * 31 + i / 4099);
+    }
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(data);
+    file.close();
+
+    QSharedPointer<QFile> source(new QFile(file.fileName()));
+    UploadJob* upload = new UploadJob(source, ownId);
+    const QString token = m_lanLinkProvider.registerUpload(upload);
+    upload->setTransferToken(m_lanLinkProvider.payloadPort(), token, UploadJob::s_maxRangeConnections);
+    upload->start();
+
+    QVariantMap transferInfo = upload->transferInfo();
+    QCOMPARE(transferInfo.value(QStringLiteral("rangeConnections")).toInt(), UploadJob::s_maxRangeConnections);
+    transferInfo.insert(QStringLiteral("deviceId"), ownId);
+
+    RangedDownload* download = new RangedDownload(QHostAddress::LocalHost, transferInfo, data.size());
+    QSharedPointer<QIODevice> payload(download);
+    download->start();
+    QCOMPARE(download->connectionCount(), RangedDownload::s_initialConnections);
+
+    QByteArray received;
+    QTRY_VERIFY_WITH_TIMEOUT((received += payload->readAll()).size() == data.size(), 20000);
+    QVERIFY(received == data);
+    QTRY_VERIFY(payload->atEnd());
+    QVERIFY(payload->errorString().isEmpty() || payload->errorString() == QStringLiteral("Unknown error"));
+
+    kcc->removeTrustedDevice(ownId);
+    LanLinkProvider::forgetSslState(ownId);
+}
+
+void LanLinkProviderTest::payloadResumedAfterConnectionDrop()
+{
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    const QString ownId = kcc->deviceId();
+    kcc->addTrustedDevice(ownId, kcc->name(), QStringLiteral("desktop"));
+    kcc->setDeviceProperty(ownId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+    LanLinkProvider::forgetSslState(ownId);
+
+    QByteArray data(4 * 1024 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = char(i * 7 + i / 3001);
+    }
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(data);
+    file.close();
+
+    UploadJob* upload = new UploadJob(QSharedPointer<QFile>(new QFile(file.fileName())), ownId);
+    int uploadError = -1;
+    connect(upload, &KJob::result, this, [&uploadError](KJob* job) {
+        uploadError = job->error();
+    });
+    const QString token = m_lanLinkProvider.registerUpload(upload);
+    upload->setTransferToken(m_lanLinkProvider.payloadPort(), token);
+    //Resumed payloads come without the checksum, the data still has to be complete
+    upload->setChecksumTrailer(true);
+    upload->start();
+
+    QVariantMap transferInfo = upload->transferInfo();
+    QCOMPARE(transferInfo.value(QStringLiteral("checksum")).toString(), QStringLiteral("xxh64"));
+    transferInfo.insert(QStringLiteral("deviceId"), ownId);
+    transferInfo.insert(QStringLiteral("size"), data.size());
+
+    DownloadJob* download = new DownloadJob(QHostAddress::LocalHost, transferInfo);
+    QSharedPointer<QIODevice> payload = download->getPayload();
+    QSignalSpy finished(payload.data(), &QIODevice::readChannelFinished);
+
+    //Like losing the network, the rest of what the uploader had sent never arrives
+    QByteArray received;
+    bool dropped = false;
+    connect(payload.data(), &QIODevice::readyRead, this, [&]() {
+        received += payload->readAll();
+        if (!dropped && received.size() > data.size() / 4) {
+            dropped = true;
+            payload->findChild<QSslSocket*>()->disconnectFromHost();
+        }
+    });
+    download->start();
+
+    QVERIFY(finished.wait(20000));
+    received += payload->readAll();
+    QVERIFY(dropped);
+    QCOMPARE(received.size(), data.size());
+    QVERIFY(received == data);
+    QVERIFY(payload->atEnd());
+
+    QTRY_COMPARE(uploadError, 0);
+
+    kcc->removeTrustedDevice(ownId);
+    LanLinkProvider::forgetSslState(ownId);
+}
+
+void LanLinkProviderTest::payloadRestartedBeforeAnythingRead()
+{
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    const QString ownId = kcc->deviceId();
+    kcc->addTrustedDevice(ownId, kcc->name(), QStringLiteral("desktop"));
+    kcc->setDeviceProperty(ownId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+    LanLinkProvider::forgetSslState(ownId);
+
+    QByteArray data(4 * 1024 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = char(i * 13 + i / 2003);
+    }
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(data);
+    file.close();
+
+    UploadJob* upload = new UploadJob(QSharedPointer<QFile>(new QFile(file.fileName())), ownId);
+    int uploadError = -1;
+    connect(upload, &KJob::result, this, [&uploadError](KJob* job) {
+        uploadError = job->error();
+    });
+    const QString token = m_lanLinkProvider.registerUpload(upload);
+    upload->setTransferToken(m_lanLinkProvider.payloadPort(), token);
+    upload->setChecksumTrailer(true);
+    upload->start();
+
+    QVariantMap transferInfo = upload->transferInfo();
+    transferInfo.insert(QStringLiteral("deviceId"), ownId);
+    transferInfo.insert(QStringLiteral("size"), data.size());
+
+    DownloadJob* download = new DownloadJob(QHostAddress::LocalHost, transferInfo);
+    QSharedPointer<QIODevice> payload = download->getPayload();
+    QSignalSpy finished(payload.data(), &QIODevice::readChannelFinished);
+
+    //The uploader already sent the first chunks, but they are lost before the reader gets any of them
+    QByteArray received;
+    bool dropped = false;
+    connect(payload.data(), &QIODevice::readyRead, this, [&]() {
+        if (!dropped) {
+            dropped = true;
+            payload->findChild<QSslSocket*>()->abort();
+            return;
+        }
+        received += payload->readAll();
+    });
+    download->start();
+
+    QVERIFY(finished.wait(20000));
+    received += payload->readAll();
+    QVERIFY(dropped);
+    QCOMPARE(received.size(), data.size());
+    QVERIFY(received == data);
+
+    QTRY_COMPARE(uploadError, 0);
+
+    kcc->removeTrustedDevice(ownId);
+    LanLinkProvider::forgetSslState(ownId);
+}
+
+void LanLinkProviderTest::payloadFileTruncated()
+{
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    const QString ownId = kcc->deviceId();
+    kcc->addTrustedDevice(ownId, kcc->name(), QStringLiteral("desktop"));
+    kcc->setDeviceProperty(ownId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+    LanLinkProvider::forgetSslState(ownId);
+
+    //Big enough that most of it is still in the file when the first bytes arrive
+    const QByteArray data(32 * 1024 * 1024, 'x');
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write(data);
+    file.flush();
+
+    UploadJob* upload = new UploadJob(QSharedPointer<QFile>(new QFile(file.fileName())), ownId);
+    bool uploadFinished = false;
+    UploadJob::InputMode modeAtEnd = UploadJob::MappedInput;
+    connect(upload, &KJob::result, this, [&uploadFinished, &modeAtEnd, upload]() {
+        uploadFinished = true;
+        modeAtEnd = upload->inputMode();
+    });
+    upload->start();
+
+    QVariantMap transferInfo = upload->transferInfo();
+    transferInfo.insert(QStringLiteral("deviceId"), ownId);
+    DownloadJob* download = new DownloadJob(QHostAddress::LocalHost, transferInfo);
+    QSharedPointer<QIODevice> payload = download->getPayload();
+
+    //Someone else empties the file while we send it
+    QByteArray received;
+    bool truncated = false;
+    UploadJob::InputMode modeBefore = UploadJob::BufferedInput;
+    connect(payload.data(), &QIODevice::readyRead, this, [&]() {
+        if (!truncated) {
+            truncated = true;
+            modeBefore = upload->inputMode();
+            QVERIFY(file.resize(0));
+        }
+        received += payload->readAll();
+    });
+    download->start();
+
+    QTRY_VERIFY_WITH_TIMEOUT(uploadFinished, 20000);
+    QVERIFY(truncated);
+    QCOMPARE(modeBefore, UploadJob::MappedInput);
+    QCOMPARE(modeAtEnd, UploadJob::BufferedInput);
+    QVERIFY(received.size() < data.size());
+
+    kcc->removeTrustedDevice(ownId);
+    LanLinkProvider::forgetSslState(ownId);
+}
+
 void LanLinkProviderTest::addTrustedDevice()
 {
     KdeConnectConfig* kcc = KdeConnectConfig::instance();
@@ -0,0 +1,169 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../core/backends/lan/linkheartbeat.h"
+#include "../core/backends/loopback/loopbacklinkprovider.h"
+
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+//Loopback links don't send frames, but these pretend to
+class HeartbeatLinkProvider
+    : public LoopbackLinkProvider
+{
+public:
+    QStringList linkCapabilities() const override { return {LINK_CAPABILITY_HEARTBEAT}; }
+};
+
+/*
+ * The heartbeats of two links sending frames to each other, like the ends of a connection would do
+ */
+class LinkHeartbeatTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void measuresRoundTrip();
+    void detectsDeadLink();
+    void onlyWhenNegotiated();
+    void slowerWhenIdle();
+
+private:
+    HeartbeatLinkProvider* m_provider;
+    LoopbackDeviceLink* m_link;
+    LoopbackDeviceLink* m_peerLink;
+    LinkHeartbeat* m_heartbeat;
+    LinkHeartbeat* m_peer;
+    QTimer m_traffic;
+};
+
+void LinkHeartbeatTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void LinkHeartbeatTest::init()
+{
+    m_provider = new HeartbeatLinkProvider();
+    m_link = new LoopbackDeviceLink(QStringLiteral("link"), m_provider);
+    m_peerLink = new LoopbackDeviceLink(QStringLiteral("peer"), m_provider);
+    m_heartbeat = new LinkHeartbeat(m_link);
+    m_peer = new LinkHeartbeat(m_peerLink);
+
+    const NetworkPacket identity(PACKET_TYPE_IDENTITY, {{QStringLiteral("linkCapabilities"), NetworkPacket::linkCapabilities()}});
+    m_link->setPeerIdentity(identity);
+    m_peerLink->setPeerIdentity(identity);
+
+    //Queued, since frames written to a real connection arrive on a later event loop iteration
+    connect(m_heartbeat, &LinkHeartbeat::frameReady, m_peer, [this](const QByteArray& frame) {
+        m_peer->dataReceived();
+        m_peer->frameReceived(frame);
+    }, Qt::QueuedConnection);
+    connect(m_peer, &LinkHeartbeat::frameReady, m_heartbeat, [this](const QByteArray& frame) {
+        m_heartbeat->dataReceived();
+        m_heartbeat->frameReceived(frame);
+    }, Qt::QueuedConnection);
+
+    //Something is being sent all the time
+    m_traffic.setInterval(50);
+    connect(&m_traffic, &QTimer::timeout, m_heartbeat, &LinkHeartbeat::trafficSent);
+    m_traffic.start();
+}
+
+void LinkHeartbeatTest::cleanup()
+{
+    m_traffic.stop();
+    m_traffic.disconnect();
+    delete m_link;
+    delete m_peerLink;
+    delete m_provider;
+}
+
+void LinkHeartbeatTest::measuresRoundTrip()
+{
+    QCOMPARE(m_heartbeat->roundTripTime(), -1.0);
+    QTRY_VERIFY_WITH_TIMEOUT(m_heartbeat->roundTripTime() >= 0, 2000);
+    QVERIFY(m_heartbeat->roundTripJitter() >= 0);
+    //It's all in the same event loop
+    QVERIFY(m_heartbeat->roundTripTime() < LinkHeartbeat::s_minDeadTime);
+
+    //And it keeps going
+    QSignalSpy frames(m_heartbeat, &LinkHeartbeat::frameReady);
+    QTest::qWait(LinkHeartbeat::s_activeInterval * 4);
+    QVERIFY(frames.count() >= 2);
+}
+
+void LinkHeartbeatTest::detectsDeadLink()
+{
+    QTRY_VERIFY_WITH_TIMEOUT(m_heartbeat->roundTripTime() >= 0, 2000);
+
+    //The peer is gone, but we keep sending
+    disconnect(m_peer, &LinkHeartbeat::frameReady, m_heartbeat, nullptr);
+    QSignalSpy dead(m_heartbeat, &LinkHeartbeat::linkDead);
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(dead.wait(3000));
+    qDebug() << "Dead link detected after" << timer.elapsed() << "ms";
+    QVERIFY(timer.elapsed() < LinkHeartbeat::s_minDeadTime + 3 * LinkHeartbeat::s_activeInterval);
+}
+
+void LinkHeartbeatTest::onlyWhenNegotiated()
+{
+    LoopbackDeviceLink oldLink(QStringLiteral("old"), m_provider);
+    LinkHeartbeat heartbeat(&oldLink);
+    connect(&m_traffic, &QTimer::timeout, &heartbeat, &LinkHeartbeat::trafficSent);
+
+    //Nor when the peer supports it but our link doesn't (eg: Bluetooth)
+    LoopbackLinkProvider plainProvider;
+    LoopbackDeviceLink plainLink(QStringLiteral("plain"), &plainProvider);
+    plainLink.setPeerIdentity(NetworkPacket(PACKET_TYPE_IDENTITY, {{QStringLiteral("linkCapabilities"), NetworkPacket::linkCapabilities()}}));
+    QVERIFY(!plainLink.hasLinkCapability(LINK_CAPABILITY_HEARTBEAT));
+    LinkHeartbeat plainHeartbeat(&plainLink);
+    connect(&m_traffic, &QTimer::timeout, &plainHeartbeat, &LinkHeartbeat::trafficSent);
+
+    QSignalSpy frames(&heartbeat, &LinkHeartbeat::frameReady);
+    QSignalSpy plainFrames(&plainHeartbeat, &LinkHeartbeat::frameReady);
+    QTest::qWait(LinkHeartbeat::s_activeInterval * 3);
+    QCOMPARE(frames.count(), 0);
+    QCOMPARE(plainFrames.count(), 0);
+}
+
+void LinkHeartbeatTest::slowerWhenIdle()
+{
+    QTRY_VERIFY_WITH_TIMEOUT(m_heartbeat->roundTripTime() >= 0, 2000);
+
+    m_traffic.stop();
+    QTest::qWait(LinkHeartbeat::s_activeTime + 2 * LinkHeartbeat::s_activeInterval);
+
+    //Our own ping and the answer to one of the peer, at most
+    QSignalSpy frames(m_heartbeat, &LinkHeartbeat::frameReady);
+    QTest::qWait(LinkHeartbeat::s_activeInterval * 8);
+    QVERIFY(frames.count() <= 2);
+}
+
+QTEST_GUILESS_MAIN(LinkHeartbeatTest)
+
+#include "linkheartbeattest.moc"
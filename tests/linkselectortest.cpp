@@ -0,0 +1,163 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../core/linkselector.h"
+#include "../core/backends/loopback/loopbacklinkprovider.h"
+
+#include <QStandardPaths>
+#include <QTest>
+
+//A link that measured the round trip time we tell it to
+class MeasuredLink
+    : public LoopbackDeviceLink
+{
+public:
+    MeasuredLink(LoopbackLinkProvider* provider, double rtt)
+        : LoopbackDeviceLink(QStringLiteral("measured"), provider)
+        , m_rtt(rtt)
+    {
+    }
+
+    double roundTripTime() const override { return m_rtt; }
+    double roundTripJitter() const override { return m_rtt < 0? -1 : 0; }
+    double payloadThroughput() const override { return m_payloadThroughput; }
+
+    double m_rtt;
+    double m_payloadThroughput = -1;
+};
+
+class LinkSelectorTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void lowestLatencyFirst();
+    void priorityWhenUnmeasured();
+    void bulkIncludesTransferTime();
+    void payloadsByTheirOwnThroughput();
+    void hysteresis();
+    void removedLinkReplaced();
+
+private:
+    LoopbackLinkProvider* m_provider;
+};
+
+void LinkSelectorTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void LinkSelectorTest::init()
+{
+    m_provider = new LoopbackLinkProvider();
+}
+
+void LinkSelectorTest::cleanup()
+{
+    delete m_provider;
+}
+
+void LinkSelectorTest::lowestLatencyFirst()
+{
+    MeasuredLink congested(m_provider, 300), healthy(m_provider, 20);
+    LinkSelector selector;
+
+    const QVector<DeviceLink*> links = {&congested, &healthy};
+    const QVector<DeviceLink*> ordered = selector.order(links, LinkSelector::Interactive);
+    QCOMPARE(ordered.size(), 2);
+    QVERIFY(ordered.first() == &healthy);
+    //The other one is still there to fall back to
+    QVERIFY(ordered.last() == &congested);
+}
+
+void LinkSelectorTest::priorityWhenUnmeasured()
+{
+    MeasuredLink first(m_provider, -1), second(m_provider, -1);
+    LinkSelector selector;
+
+    const QVector<DeviceLink*> links = {&first, &second};
+    QCOMPARE(selector.order(links, LinkSelector::Interactive), links);
+    QCOMPARE(selector.order(links, LinkSelector::Bulk), links);
+}
+
+void LinkSelectorTest::bulkIncludesTransferTime()
+{
+    //Payloads also have to get through, not only arrive first
+    MeasuredLink link(m_provider, 5);
+    QVERIFY(LinkSelector::cost(&link, LinkSelector::Bulk) > LinkSelector::cost(&link, LinkSelector::Interactive));
+    QVERIFY(LinkSelector::cost(&link, LinkSelector::Interactive) < LinkSelector::s_defaultRoundTrip);
+}
+
+void LinkSelectorTest::payloadsByTheirOwnThroughput()
+{
+    MeasuredLink fast(m_provider, 50), slow(m_provider, 50);
+    LinkSelector selector;
+    const QVector<DeviceLink*> links = {&slow, &fast};
+
+    //Until the links sent some payloads, only their latency and priority count
+    QCOMPARE(LinkSelector::cost(&fast, LinkSelector::Payload), LinkSelector::cost(&slow, LinkSelector::Payload));
+    QCOMPARE(LinkSelector::cost(&fast, LinkSelector::Payload), LinkSelector::cost(&fast, LinkSelector::Bulk));
+
+    slow.m_payloadThroughput = LinkSelector::s_defaultThroughput / 10;
+    fast.m_payloadThroughput = LinkSelector::s_defaultThroughput * 10;
+    QVERIFY(selector.order(links, LinkSelector::Payload).first() == &fast);
+    QVERIFY(selector.order(links, LinkSelector::Bulk).first() == &slow);
+}
+
+void LinkSelectorTest::hysteresis()
+{
+    MeasuredLink a(m_provider, 100), b(m_provider, 120);
+    LinkSelector selector;
+    const QVector<DeviceLink*> links = {&a, &b};
+    QVERIFY(selector.order(links, LinkSelector::Interactive).first() == &a);
+
+    //Slightly better is not enough
+    b.m_rtt = 90;
+    QVERIFY(selector.order(links, LinkSelector::Interactive).first() == &a);
+
+    //Much better, but we just chose
+    b.m_rtt = 10;
+    QVERIFY(selector.order(links, LinkSelector::Interactive).first() == &a);
+
+    QTest::qWait(LinkSelector::s_holdTime + 100);
+    QVERIFY(selector.order(links, LinkSelector::Interactive).first() == &b);
+
+    //The choice for bulk traffic is separate
+    QVERIFY(selector.order(links, LinkSelector::Bulk).first() == &b);
+}
+
+void LinkSelectorTest::removedLinkReplaced()
+{
+    MeasuredLink a(m_provider, 10), b(m_provider, 50), c(m_provider, 40);
+    LinkSelector selector;
+    QVERIFY(selector.order({&a, &b, &c}, LinkSelector::Interactive).first() == &a);
+
+    //No need to wait when the chosen link is gone
+    selector.linkRemoved(&a);
+    QVERIFY(selector.order({&b, &c}, LinkSelector::Interactive).first() == &c);
+}
+
+QTEST_GUILESS_MAIN(LinkSelectorTest)
+
+#include "linkselectortest.moc"
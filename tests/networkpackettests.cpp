@@ -24,6 +24,8 @@
 
 #include <QtTest>
 #include <QtCrypto>
+#include <QJsonDocument>
+#include <QMetaProperty>
 
 QTEST_GUILESS_MAIN(NetworkPacketTests);
 
@@ -79,6 +81,159 @@ void NetworkPacketTests::networkPacketIdentityTest()
 
 }
 
+void NetworkPacketTests::networkPacketUnserializeTest()
+{
+    NetworkPacket np(QLatin1String(""));
+    QByteArray json("{\"id\":1439365924847,\"type\":\"test\",\"body\":{\"text\":\"a\\\"b\\\\c\\n\\u00e9\\ud83d\\ude00\",\"utf8\":\"\xc3\xa9\","
+                    "\"int\":-42,\"double\":1.5e2,\"list\":[1,\"two\",false],\"map\":{\"nested\":true}},"
+                    "\"payloadSize\":5000000000,\"payloadTransferInfo\":{\"port\":1739}}\n");
+    QVERIFY(NetworkPacket::unserialize(json, &np));
+
+    QCOMPARE( np.id(), QString("1439365924847") );
+    QCOMPARE( np.type(), QString("test") );
+    QCOMPARE( np.get<QString>("text"), QString::fromUtf8("a\"b\\c\n\xc3\xa9\xf0\x9f\x98\x80") );
+    QCOMPARE( np.get<QString>("utf8"), QString::fromUtf8("\xc3\xa9") );
+    QCOMPARE( np.get<int>("int"), -42 );
+    QCOMPARE( np.get<double>("double"), 150.0 );
+    QCOMPARE( np.get<QVariantList>("list").size(), 3 );
+    QCOMPARE( np.get<QVariantMap>("map").value("nested").toBool(), true );
+    QCOMPARE( np.payloadSize(), Q_INT64_C(5000000000) );
+    QCOMPARE( np.payloadTransferInfo().value("port").toInt(), 1739 );
+
+    //The result must match what QJsonDocument produces
+    QCOMPARE( np.body(), QJsonDocument::fromJson(json).toVariant().toMap().value("body").toMap() );
+
+    QVERIFY(!NetworkPacket::unserialize("this is not json", &np));
+    QVERIFY(!NetworkPacket::unserialize("{\"id\":\"1\",\"type\":\"test\"", &np));
+    QVERIFY(!NetworkPacket::unserialize("{\"id\":\"1\"} trailing", &np));
+}
+
+void NetworkPacketTests::networkPacketLazyBodyTest()
+{
+    NetworkPacket np(QLatin1String(""));
+    QByteArray json("{\"id\":\"1\",\"type\":\"test\",\"body\":{\"deviceId\":\"abc\",\"text\":\"\\u00e9\",\"int\":7,"
+                    "\"list\":[1,[2,{\"three\":3}]],\"map\":{\"nested\":true}}}\n");
+    QVERIFY(NetworkPacket::unserialize(json, &np, NetworkPacket::LazyBody));
+
+    QVERIFY( np.has("text") );
+    QVERIFY( !np.has("missing") );
+    QCOMPARE( np.get<QString>("text"), QString::fromUtf8("\xc3\xa9") );
+    QCOMPARE( np.get<int>("int"), 7 );
+    QCOMPARE( np.get<int>("missing", -1), -1 );
+    QCOMPARE( np.get<QString>("deviceId"), QString("abc") );
+
+    //Overwriting a value that was never decoded must not bring the old one back
+    np.set(QStringLiteral("map"), 1);
+    QCOMPARE( np.get<int>("map"), 1 );
+
+    //Packet copies keep the undecoded members
+    NetworkPacket copy = np;
+    QCOMPARE( copy.get<QVariantList>("list").size(), 2 );
+
+    QVariantMap expected = QJsonDocument::fromJson(json).toVariant().toMap().value("body").toMap();
+    expected[QStringLiteral("map")] = 1;
+    QCOMPARE( np.body(), expected );
+    QCOMPARE( copy.body(), expected );
+
+    //Malformed values are rejected even if they are never accessed
+    QVERIFY(!NetworkPacket::unserialize("{\"id\":\"1\",\"type\":\"test\",\"body\":{\"a\":[1,}}", &np, NetworkPacket::LazyBody));
+    QVERIFY(!NetworkPacket::unserialize("{\"id\":\"1\",\"type\":\"test\",\"body\":{\"a\":\"\\x\"}}", &np, NetworkPacket::LazyBody));
+    QVERIFY(!NetworkPacket::unserialize("{\"id\":\"1\",\"type\":\"test\",\"body\":{\"a\":tru}}", &np, NetworkPacket::LazyBody));
+}
+
+void NetworkPacketTests::networkPacketCborTest()
+{
+    if (!NetworkPacket::linkCapabilities().contains(LINK_CAPABILITY_CBOR)) {
+        QSKIP("This build doesn't support CBOR packets");
+    }
+
+    NetworkPacket np(QStringLiteral("kdeconnect.mpris"));
+    np.set(QStringLiteral("player"), QStringLiteral("VLC"));
+    np.set(QStringLiteral("pos"), 123456);
+    np.set(QStringLiteral("isPlaying"), true);
+
+    const QByteArray frame = np.serialize(NetworkPacket::CborFormat);
+    QCOMPARE( frame.at(0), char(0x01) );
+    QCOMPARE( NetworkPacket::binaryFrameSize(frame.constData(), frame.size()), qint64(frame.size()) );
+    QVERIFY( frame.size() < np.serialize().size() );
+
+    NetworkPacket np2(QLatin1String(""));
+    QVERIFY(NetworkPacket::unserialize(frame, &np2));
+    QCOMPARE( np2.id(), np.id() );
+    QCOMPARE( np2.type(), np.type() );
+    QCOMPARE( np2.get<QString>("player"), QString("VLC") );
+    QCOMPARE( np2.get<int>("pos"), 123456 );
+    QCOMPARE( np2.get<bool>("isPlaying"), true );
+
+    QVERIFY(!NetworkPacket::unserialize(frame.left(frame.size() - 1), &np2));
+}
+
+//The unserialization path used before the direct decoder, kept here to compare against it
+static void unserializeThroughVariant(const QByteArray& json, NetworkPacket* np)
+{
+    const QVariantMap variant = QJsonDocument::fromJson(json).toVariant().toMap();
+    const QMetaObject& metaObject = NetworkPacket::staticMetaObject;
+    for (QVariantMap::const_iterator iter = variant.begin(); iter != variant.end(); ++iter) {
+        const int propertyIndex = metaObject.indexOfProperty(iter.key().toLatin1());
+        if (propertyIndex >= 0) {
+            metaObject.property(propertyIndex).writeOnGadget(np, *iter);
+        }
+    }
+}
+
+void NetworkPacketTests::networkPacketUnserializeBenchmark_data()
+{
+    QTest::addColumn<QByteArray>("json");
+    QTest::addColumn<QString>("decoder");
+    QTest::addColumn<QString>("key");
+
+    const QByteArray mousepad("{\"id\":1519918254000,\"type\":\"kdeconnect.mousepad.request\",\"body\":{\"dx\":4.5,\"dy\":-2.25}}\n");
+    const QByteArray mpris("{\"id\":1519918254000,\"type\":\"kdeconnect.mpris\",\"body\":{\"player\":\"VLC media player\",\"nowPlaying\":\"Artist - Title\","
+                           "\"isPlaying\":true,\"pos\":123456,\"length\":240000,\"volume\":75,\"canSeek\":true,\"canPlay\":true,\"canPause\":true,"
+                           "\"canGoNext\":true,\"canGoPrevious\":false}}\n");
+    QByteArray vcards("{\"id\":1519918254000,\"type\":\"kdeconnect.contacts.response_vcards\",\"body\":{\"uids\":[");
+    for (int i = 0; i < 200; ++i) {
+        vcards += (i ? ",\"" : "\"") + QByteArray::number(i) + '"';
+    }
+    vcards += ']';
+    for (int i = 0; i < 200; ++i) {
+        vcards += ",\"" + QByteArray::number(i) + "\":\"BEGIN:VCARD\\nVERSION:2.1\\nFN:Contact " + QByteArray::number(i)
+                + "\\nTEL;CELL:+34600000" + QByteArray::number(i) + "\\nEND:VCARD\"";
+    }
+    vcards += "}}\n";
+
+    //Each row reads back one body member, like a plugin handling the packet would
+    const QStringList decoders = { QStringLiteral("qvariant"), QStringLiteral("direct"), QStringLiteral("lazy") };
+    for (const QString& decoder : decoders) {
+        QTest::newRow(qPrintable(QStringLiteral("mousepad/") + decoder)) << mousepad << decoder << QStringLiteral("dx");
+        QTest::newRow(qPrintable(QStringLiteral("mpris/") + decoder)) << mpris << decoder << QStringLiteral("isPlaying");
+        QTest::newRow(qPrintable(QStringLiteral("vcards/") + decoder)) << vcards << decoder << QStringLiteral("uids");
+    }
+}
+
+void NetworkPacketTests::networkPacketUnserializeBenchmark()
+{
+    QFETCH(QByteArray, json);
+    QFETCH(QString, decoder);
+    QFETCH(QString, key);
+
+    NetworkPacket np(QLatin1String(""));
+    if (decoder == QLatin1String("qvariant")) {
+        QBENCHMARK {
+            unserializeThroughVariant(json, &np);
+            np.get<QVariant>(key);
+        }
+    } else {
+        const NetworkPacket::BodyDecoding decoding = (decoder == QLatin1String("lazy"))? NetworkPacket::LazyBody : NetworkPacket::EagerBody;
+        QBENCHMARK {
+            NetworkPacket::unserialize(json, &np, decoding);
+            np.get<QVariant>(key);
+        }
+    }
+    QVERIFY(!np.type().isEmpty());
+    QVERIFY(np.has(key));
+}
+
 void NetworkPacketTests::cleanupTestCase()
 {
     // Called after the last testfunction was executed
@@ -32,6 +32,11 @@ private Q_SLOTS:
 
     void networkPacketTest();
     void networkPacketIdentityTest();
+    void networkPacketUnserializeTest();
+    void networkPacketLazyBodyTest();
+    void networkPacketCborTest();
+    void networkPacketUnserializeBenchmark_data();
+    void networkPacketUnserializeBenchmark();
     //void networkPacketEncryptionTest();
 
     void cleanupTestCase();
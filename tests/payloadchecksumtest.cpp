@@ -0,0 +1,98 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../core/backends/lan/payloadchecksum.h"
+
+#include <QElapsedTimer>
+#include <QTest>
+
+class PayloadChecksumTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void knownValues_data();
+    void knownValues();
+    void splitInput();
+    void benchmarkChecksum();
+};
+
+void PayloadChecksumTest::knownValues_data()
+{
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<quint64>("checksum");
+
+    //Reference values of XXH64 with seed 0
+    QTest::newRow("empty") << QByteArray() << Q_UINT64_C(0xef46db3751d8e999);
+    QTest::newRow("short") << QByteArray("abc") << Q_UINT64_C(0x44bc2cf5ad770999);
+    QTest::newRow("long") << QByteArray("Nobody inspects the spammish repetition") << Q_UINT64_C(0xfbcea83c8a378bf1);
+}
+
+void PayloadChecksumTest::knownValues()
+{
+    QFETCH(QByteArray, input);
+    QFETCH(quint64, checksum);
+
+    PayloadChecksum hash;
+    hash.addData(input);
+    QCOMPARE(hash.result(), checksum);
+}
+
+void PayloadChecksumTest::splitInput()
+{
+    QByteArray data(10000, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = char(i * 7 + i / 13);
+    }
+
+    PayloadChecksum whole;
+    whole.addData(data);
+
+    //Pieces smaller and bigger than a stripe, not aligned to it
+    for (int pieceSize : {1, 7, 31, 33, 1000}) {
+        PayloadChecksum pieces;
+        for (int i = 0; i < data.size(); i += pieceSize) {
+            pieces.addData(data.mid(i, pieceSize));
+        }
+        QCOMPARE(pieces.result(), whole.result());
+    }
+
+    whole.reset();
+    QCOMPARE(whole.result(), Q_UINT64_C(0xef46db3751d8e999));
+}
+
+void PayloadChecksumTest::benchmarkChecksum()
+{
+    const QByteArray data(64 * 1024 * 1024, 'k');
+    PayloadChecksum hash;
+    QElapsedTimer timer;
+    QBENCHMARK_ONCE {
+        timer.start();
+        for (int i = 0; i < data.size(); i += 64 * 1024) {
+            hash.addData(data.constData() + i, 64 * 1024);
+        }
+        hash.result();
+    }
+    qDebug() << "Checksum of" << data.size() / (1024 * 1024) << "MiB at" << (data.size() / 1024.0 / 1024.0) / (qMax<qint64>(timer.elapsed(), 1) / 1000.0) << "MiB/s";
+}
+
+QTEST_GUILESS_MAIN(PayloadChecksumTest)
+
+#include "payloadchecksumtest.moc"
@@ -0,0 +1,198 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../core/backends/lan/payloadstreams.h"
+#include "../core/backends/loopback/loopbacklinkprovider.h"
+
+#include <QBuffer>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QtEndian>
+
+/*
+ * Two PayloadStreams sending frames to each other, like the ends of a link would do
+ */
+class PayloadStreamsTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void streamPayload();
+    void senderWaitsForWindow();
+    void receiverCancels();
+    void senderOverruns();
+
+private:
+    static QByteArray testData(int size);
+    static QByteArray dataFrame(quint32 id, const QByteArray& data);
+
+    LoopbackLinkProvider* m_provider;
+    LoopbackDeviceLink* m_senderLink;
+    LoopbackDeviceLink* m_receiverLink;
+    PayloadStreams* m_sender;
+    PayloadStreams* m_receiver;
+};
+
+void PayloadStreamsTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void PayloadStreamsTest::init()
+{
+    m_provider = new LoopbackLinkProvider();
+    m_senderLink = new LoopbackDeviceLink(QStringLiteral("sender"), m_provider);
+    m_receiverLink = new LoopbackDeviceLink(QStringLiteral("receiver"), m_provider);
+    m_sender = new PayloadStreams(m_senderLink);
+    m_receiver = new PayloadStreams(m_receiverLink);
+
+    //Queued, since frames written to a real connection arrive on a later event loop iteration
+    connect(m_sender, &PayloadStreams::frameReady, m_receiver, [this](const QByteArray& frame) {
+        m_receiver->frameReceived(frame);
+    }, Qt::QueuedConnection);
+    connect(m_receiver, &PayloadStreams::frameReady, m_sender, [this](const QByteArray& frame) {
+        m_sender->frameReceived(frame);
+    }, Qt::QueuedConnection);
+}
+
+void PayloadStreamsTest::cleanup()
+{
+    delete m_senderLink;
+    delete m_receiverLink;
+    delete m_provider;
+}
+
+QByteArray PayloadStreamsTest::testData(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i) {
+        data[i] = char(i * 31 + i / 251);
+    }
+    return data;
+}
+
+QByteArray PayloadStreamsTest::dataFrame(quint32 id, const QByteArray& data)
+{
+    QByteArray frame(NetworkPacket::s_frameHeaderSize + 4, Qt::Uninitialized);
+    frame[0] = NetworkPacket::s_streamDataMarker;
+    qToBigEndian<quint32>(quint32(4 + data.size()), reinterpret_cast<uchar*>(frame.data() + 1));
+    qToBigEndian<quint32>(id, reinterpret_cast<uchar*>(frame.data() + NetworkPacket::s_frameHeaderSize));
+    return frame + data;
+}
+
+void PayloadStreamsTest::streamPayload()
+{
+    const QByteArray data = testData(int(PayloadStreams::s_window * 3 + 123));
+    QSharedPointer<QBuffer> source(new QBuffer());
+    source->setData(data);
+
+    const quint32 id = m_sender->send(source, data.size());
+    QVERIFY(id != 0);
+
+    QSharedPointer<QIODevice> payload = m_receiver->receive(id, data.size());
+    QByteArray received;
+    connect(payload.data(), &QIODevice::readyRead, this, [&]() {
+        received += payload->readAll();
+    });
+    QSignalSpy finished(payload.data(), &QIODevice::readChannelFinished);
+
+    QVERIFY(finished.wait(5000));
+    received += payload->readAll();
+    QCOMPARE(received.size(), data.size());
+    QVERIFY(received == data);
+    QVERIFY(payload->atEnd());
+    QVERIFY(!source->isOpen());
+}
+
+void PayloadStreamsTest::senderWaitsForWindow()
+{
+    const QByteArray data = testData(int(PayloadStreams::s_window * 2));
+    QSharedPointer<QBuffer> source(new QBuffer());
+    source->setData(data);
+
+    const quint32 id = m_sender->send(source, data.size());
+    QSharedPointer<QIODevice> payload = m_receiver->receive(id, data.size());
+
+    //Nobody reads, so the sender stops once the window is used up
+    QTest::qWait(200);
+    QCOMPARE(payload->bytesAvailable(), PayloadStreams::s_window);
+
+    QByteArray received;
+    QSignalSpy finished(payload.data(), &QIODevice::readChannelFinished);
+    connect(payload.data(), &QIODevice::readyRead, this, [&]() {
+        received += payload->readAll();
+    });
+    received += payload->readAll();
+
+    QVERIFY(finished.wait(5000));
+    received += payload->readAll();
+    QVERIFY(received == data);
+}
+
+void PayloadStreamsTest::receiverCancels()
+{
+    const QByteArray data = testData(int(PayloadStreams::s_window * 2));
+    QSharedPointer<QBuffer> source(new QBuffer());
+    source->setData(data);
+
+    const quint32 id = m_sender->send(source, data.size());
+    QSharedPointer<QIODevice> payload = m_receiver->receive(id, data.size());
+    QTest::qWait(100);
+    QVERIFY(source->isOpen());
+
+    //Dropping the payload tells the sender to stop
+    payload.reset();
+    QTRY_VERIFY(!source->isOpen());
+}
+
+void PayloadStreamsTest::senderOverruns()
+{
+    QSignalSpy frames(m_receiver, &PayloadStreams::frameReady);
+
+    //More than the size it announced
+    QSharedPointer<QIODevice> small = m_receiver->receive(1, 10);
+    QSignalSpy smallFinished(small.data(), &QIODevice::readChannelFinished);
+    m_receiver->frameReceived(dataFrame(1, testData(20)));
+    QCOMPARE(smallFinished.count(), 1);
+    QCOMPARE(small->bytesAvailable(), qint64(0));
+    QVERIFY(!small->errorString().isEmpty());
+
+    //More than the window, for a payload of unknown size
+    QSharedPointer<QIODevice> unknown = m_receiver->receive(2, -1);
+    QSignalSpy unknownFinished(unknown.data(), &QIODevice::readChannelFinished);
+    m_receiver->frameReceived(dataFrame(2, testData(int(PayloadStreams::s_window / 2))));
+    QCOMPARE(unknownFinished.count(), 0);
+    m_receiver->frameReceived(dataFrame(2, testData(int(PayloadStreams::s_window / 2) + 1)));
+    QCOMPARE(unknownFinished.count(), 1);
+    QCOMPARE(unknown->bytesAvailable(), PayloadStreams::s_window / 2);
+
+    //The sender is told to stop both
+    QCOMPARE(frames.count(), 2);
+    QCOMPARE(frames.at(0).at(0).toByteArray().at(0), NetworkPacket::s_streamCloseMarker);
+}
+
+QTEST_GUILESS_MAIN(PayloadStreamsTest)
+
+#include "payloadstreamstest.moc"
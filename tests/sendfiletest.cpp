@@ -25,13 +25,20 @@
 #include <core/filetransferjob.h>
 #include <QApplication>
 #include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QTemporaryDir>
 #include <QTest>
 #include <QTemporaryFile>
+#include <QElapsedTimer>
 #include <QSignalSpy>
 #include <QStandardPaths>
 
 #include <KIO/AccessManager>
 
+#include <ctime>
+
 #include "core/daemon.h"
 #include "core/device.h"
 #include "core/kdeconnectplugin.h"
@@ -140,6 +147,137 @@ class TestSendFile : public QObject
             QCOMPARE(resultFile.readAll(), originFile.readAll());
         }
 
+        //What a previous transfer left is thrown away if the origin can't continue from there
+        void testCantResume()
+        {
+            QTemporaryDir dir;
+            const QString destination = dir.path() + QStringLiteral("/received");
+            const QByteArray content(64 * 1024, 'k');
+
+            QFile part(destination + QStringLiteral(".part"));
+            QVERIFY(part.open(QIODevice::WriteOnly));
+            part.write(QByteArray(1000, 'x'));
+            part.close();
+            QFile state(destination + QStringLiteral(".part.json"));
+            QVERIFY(state.open(QIODevice::WriteOnly));
+            state.write("{\"size\":" + QByteArray::number(content.size()) + ",\"from\":\"testdevice\"}");
+            state.close();
+
+            QSharedPointer<QBuffer> origin(new QBuffer());
+            origin->setData(content);
+            QVERIFY(origin->open(QIODevice::ReadOnly));
+            FileTransferJob* job = new FileTransferJob(origin, content.size(), QUrl::fromLocalFile(destination));
+            job->setOriginName(QStringLiteral("testdevice"));
+            int error = -1;
+            connect(job, &KJob::result, this, [&error](KJob* job) {
+                error = job->error();
+            });
+            job->start();
+            QTRY_VERIFY_WITH_TIMEOUT(error != -1, 10000);
+            QCOMPARE(error, 0);
+
+            QFile received(destination);
+            QVERIFY(received.open(QIODevice::ReadOnly));
+            QCOMPARE(received.readAll(), content);
+        }
+
+        //Set KDECONNECT_BENCHMARK_SIZE (in MiB) to transfer something else than 64 MiB
+        void benchmarkSslJobs()
+        {
+            const qint64 size = qEnvironmentVariableIsSet("KDECONNECT_BENCHMARK_SIZE")? qgetenv("KDECONNECT_BENCHMARK_SIZE").toLongLong() * 1024 * 1024 : 64 * 1024 * 1024;
+
+            QTemporaryFile source;
+            QVERIFY(source.open());
+            const QByteArray block(1024 * 1024, 'k');
+            for (qint64 written = 0; written < size; written += block.size()) {
+                QCOMPARE(source.write(block), qint64(block.size()));
+            }
+            source.close();
+
+            const QString deviceId = KdeConnectConfig::instance()->deviceId();
+            KdeConnectConfig* kcc = KdeConnectConfig::instance();
+            kcc->addTrustedDevice(deviceId, QStringLiteral("testdevice"), kcc->deviceType());
+            kcc->setDeviceProperty(deviceId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+
+            qint64 received = 0;
+            QElapsedTimer timer;
+            QBENCHMARK_ONCE {
+                timer.start();
+                UploadJob* uj = new UploadJob(QSharedPointer<QFile>(new QFile(source.fileName())), deviceId);
+                uj->start();
+
+                auto info = uj->transferInfo();
+                info.insert(QStringLiteral("deviceId"), deviceId);
+                DownloadJob* dj = new DownloadJob(QHostAddress::LocalHost, info);
+                QSharedPointer<QIODevice> payload = dj->getPayload();
+
+                //Read as fast as possible, what we measure is the sending side
+                QEventLoop loop;
+                connect(payload.data(), &QIODevice::readyRead, &loop, [&]() {
+                    received += payload->readAll().size();
+                    if (received >= size) {
+                        loop.quit();
+                    }
+                });
+                connect(payload.data(), &QIODevice::readChannelFinished, &loop, &QEventLoop::quit);
+                dj->start();
+                loop.exec();
+            }
+
+            QCOMPARE(received, size);
+            qDebug() << "Sent" << size / (1024 * 1024) << "MiB at" << (size / 1024.0 / 1024.0) / (timer.elapsed() / 1000.0) << "MiB/s";
+        }
+
+        //Writing to a local file directly against going through the network access manager, which is
+        //what remote destinations use. Also takes KDECONNECT_BENCHMARK_SIZE.
+        void benchmarkFileTransferJob_data()
+        {
+            QTest::addColumn<bool>("direct");
+            QTest::newRow("local file") << true;
+            QTest::newRow("network access manager") << false;
+        }
+
+        void benchmarkFileTransferJob()
+        {
+            QFETCH(bool, direct);
+            const qint64 size = qEnvironmentVariableIsSet("KDECONNECT_BENCHMARK_SIZE")? qgetenv("KDECONNECT_BENCHMARK_SIZE").toLongLong() * 1024 * 1024 : 64 * 1024 * 1024;
+
+            QSharedPointer<QBuffer> origin(new QBuffer());
+            origin->setData(QByteArray(int(size), 'k'));
+            QVERIFY(origin->open(QIODevice::ReadOnly));
+
+            QTemporaryDir dir;
+            const QUrl destination = QUrl::fromLocalFile(dir.path() + QStringLiteral("/received"));
+
+            QElapsedTimer timer;
+            std::clock_t cpu = 0;
+            QBENCHMARK_ONCE {
+                timer.start();
+                cpu = std::clock();
+                if (direct) {
+                    FileTransferJob* job = new FileTransferJob(origin, size, destination);
+                    int error = -1;
+                    connect(job, &KJob::result, this, [&error](KJob* job) {
+                        error = job->error();
+                    });
+                    job->start();
+                    QTRY_VERIFY_WITH_TIMEOUT(error != -1, 60000);
+                    QCOMPARE(error, 0);
+                } else {
+                    QNetworkReply* reply = m_daemon->networkAccessManager()->put(QNetworkRequest(destination), origin.data());
+                    QSignalSpy finished(reply, &QNetworkReply::finished);
+                    QVERIFY(finished.count() || finished.wait(60000));
+                    QCOMPARE(reply->error(), QNetworkReply::NoError);
+                    reply->deleteLater();
+                }
+            }
+
+            const qint64 cpuMs = qint64(std::clock() - cpu) * 1000 / CLOCKS_PER_SEC;
+            QCOMPARE(QFileInfo(destination.toLocalFile()).size(), size);
+            qDebug() << "Wrote" << size / (1024 * 1024) << "MiB at" << (size / 1024.0 / 1024.0) / (qMax<qint64>(timer.elapsed(), 1) / 1000.0)
+                     << "MiB/s using" << cpuMs << "ms of CPU";
+        }
+
     private:
         TestDaemon* m_daemon;
 };
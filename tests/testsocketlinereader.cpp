@@ -34,6 +34,7 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void socketLineReader();
+    void socketLineReaderBurst();
 
 private:
     QTimer m_timer;
@@ -96,6 +97,42 @@ void TestSocketLineReader::socketLineReader()
     }
 }
 
+void TestSocketLineReader::socketLineReaderBurst()
+{
+    //Reuses the connection and the reader from the previous test
+    QVERIFY(m_reader);
+    disconnect(m_reader, &SocketLineReader::readyRead, this, &TestSocketLineReader::newPacket);
+
+    const int lineCount = 2000;
+    QByteArray burst;
+    for (int i = 0; i < lineCount; ++i) {
+        burst += "{\"id\":" + QByteArray::number(i) + ",\"type\":\"kdeconnect.notification\",\"body\":{}}\n";
+    }
+
+    QList<QByteArray> received;
+    int readyReadCount = 0;
+    connect(m_reader, &SocketLineReader::readyRead, this, [&]() {
+        ++readyReadCount;
+        while (m_reader->bytesAvailable() > 0) {
+            received.append(m_reader->readLine());
+        }
+        if (received.count() == lineCount) {
+            m_loop.exit();
+        }
+    });
+
+    m_conn->write(burst);
+    m_conn->flush();
+    m_timer.start();
+    m_loop.exec();
+
+    QCOMPARE(received.count(), lineCount);
+    QCOMPARE(received.join(), burst);
+
+    //Every readyRead hands out all the lines available, not one per event loop iteration
+    QVERIFY(readyReadCount < lineCount / 10);
+}
+
 void TestSocketLineReader::newPacket()
 {
     if (!m_reader->bytesAvailable()) {
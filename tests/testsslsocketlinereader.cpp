@@ -18,11 +18,17 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../core/backends/lan/lanlinkprovider.h"
 #include "../core/backends/lan/server.h"
 #include "../core/backends/lan/socketlinereader.h"
+#include "../core/kdeconnectconfig.h"
 
+#include <QFile>
+#include <QProcess>
 #include <QSslKey>
+#include <QStandardPaths>
 #include <QtCrypto>
+#include <QTemporaryDir>
 #include <QTest>
 #include <QTimer>
 
@@ -46,7 +52,8 @@ private Q_SLOTS:
     void testTrustedDevice();
     void testUntrustedDevice();
     void testTrustedDeviceWithWrongCertificate();
-
+    void handshakeLatency_data();
+    void handshakeLatency();
 
 private:
     const int PORT = 7894;
@@ -60,10 +67,14 @@ private:
 
 private:
     void setSocketAttributes(QSslSocket* socket, QString deviceName);
+    QSslCertificate createCertificate(const QString& deviceName, const QCA::PrivateKey& privKey);
 };
 
 void TestSslSocketLineReader::initTestCase()
 {
+    //For the handshakes that use our own configuration
+    QStandardPaths::setTestModeEnabled(true);
+
     m_server = new Server(this);
 
     QVERIFY2(m_server->listen(QHostAddress::LocalHost, PORT), "Failed to create local tcp server");
@@ -261,6 +272,112 @@ void TestSslSocketLineReader::testTrustedDeviceWithWrongCertificate()
 
 }
 
+void TestSslSocketLineReader::handshakeLatency_data()
+{
+    QTest::addColumn<bool>("resume");
+
+    QTest::newRow("cold") << false;
+    QTest::newRow("resumed") << true;
+}
+
+/*
+ * Measures what reconnecting to a trusted device costs with and without a cached TLS session, with
+ * sockets configured like the LAN links do. A cold handshake is the first one to a device, with
+ * nothing cached. QSslSocket can only resume sessions as a client (each server socket has its own
+ * context), so the peer here is an openssl server, like the TLS stack of the Android app is.
+ */
+void TestSslSocketLineReader::handshakeLatency()
+{
+    QFETCH(bool, resume);
+
+    const QString openssl = QStandardPaths::findExecutable(QStringLiteral("openssl"));
+    if (openssl.isEmpty()) {
+        QSKIP("openssl is needed to run a TLS server that supports resumption");
+    }
+
+    //The server is a trusted device, so its certificate is the one we pin
+    const QString deviceId = QStringLiteral("testdevice");
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString keyPath = dir.filePath(QStringLiteral("key.pem"));
+    const QString certificatePath = dir.filePath(QStringLiteral("certificate.pem"));
+    QCA::PrivateKey privKey = QCA::KeyGenerator().createRSA(2048);
+    QVERIFY(privKey.toPEMFile(keyPath));
+    const QSslCertificate certificate = createCertificate(deviceId, privKey);
+    QFile certificateFile(certificatePath);
+    QVERIFY(certificateFile.open(QIODevice::WriteOnly));
+    certificateFile.write(certificate.toPem());
+    certificateFile.close();
+
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    kcc->addTrustedDevice(deviceId, QStringLiteral("Test Device"), QStringLiteral("phone"));
+    kcc->setDeviceProperty(deviceId, QStringLiteral("certificate"), QString::fromLatin1(certificate.toPem()));
+    LanLinkProvider::forgetSslState(deviceId);
+
+    //Our sockets still offer old protocols and ciphers for old Android devices
+    const quint16 port = PORT + 1;
+    QProcess server;
+    server.start(openssl, {QStringLiteral("s_server"), QStringLiteral("-quiet"),
+                           QStringLiteral("-accept"), QString::number(port),
+                           QStringLiteral("-min_protocol"), QStringLiteral("TLSv1"),
+                           QStringLiteral("-cipher"), QStringLiteral("ALL:@SECLEVEL=0"),
+                           QStringLiteral("-key"), keyPath, QStringLiteral("-cert"), certificatePath});
+    QVERIFY(server.waitForStarted());
+
+    int maxAttempts = 50;
+    for (; maxAttempts > 0; --maxAttempts) {
+        QTcpSocket probe;
+        probe.connectToHost(QHostAddress::LocalHost, port);
+        if (probe.waitForConnected(100)) {
+            break;
+        }
+        QTest::qWait(100);
+    }
+    QVERIFY2(maxAttempts > 0, "openssl s_server did not start listening");
+
+    bool gotSession = false;
+    auto handshake = [&]() {
+        if (!resume) {
+            LanLinkProvider::forgetSslState(deviceId);
+        }
+        QSslSocket socket;
+        LanLinkProvider::configureSslSocket(&socket, deviceId, true);
+        socket.connectToHost(QHostAddress::LocalHost, port);
+        bool encrypted = socket.waitForConnected(5000);
+        if (encrypted) {
+            socket.startClientEncryption();
+            encrypted = socket.waitForEncrypted(5000);
+        }
+        gotSession = encrypted && !socket.sslConfiguration().sessionTicket().isEmpty();
+        socket.disconnectFromHost();
+        if (socket.state() != QAbstractSocket::UnconnectedState) {
+            socket.waitForDisconnected(1000);
+        }
+        return encrypted;
+    };
+
+    //The first handshake is always a cold one, and caches the session to resume
+    if (!handshake()) {
+        server.kill();
+        server.waitForFinished();
+        kcc->removeTrustedDevice(deviceId);
+        LanLinkProvider::forgetSslState(deviceId);
+        QSKIP("This openssl doesn't accept the protocols our sockets offer");
+    }
+    if (resume) {
+        QVERIFY(gotSession);
+    }
+
+    QBENCHMARK {
+        QVERIFY(handshake());
+    }
+
+    server.kill();
+    server.waitForFinished();
+    kcc->removeTrustedDevice(deviceId);
+    LanLinkProvider::forgetSslState(deviceId);
+}
+
 void TestSslSocketLineReader::newPacket()
 {
     if (!m_reader->bytesAvailable()) {
@@ -283,6 +400,16 @@ void TestSslSocketLineReader::newPacket()
 
 void TestSslSocketLineReader::setSocketAttributes(QSslSocket* socket, QString deviceName) {
 
+    QCA::PrivateKey privKey = QCA::KeyGenerator().createRSA(2048);
+    QSslCertificate certificate = createCertificate(deviceName, privKey);
+
+    socket->setPrivateKey(QSslKey(privKey.toPEM().toLatin1(), QSsl::Rsa));
+    socket->setLocalCertificate(certificate);
+
+}
+
+QSslCertificate TestSslSocketLineReader::createCertificate(const QString& deviceName, const QCA::PrivateKey& privKey)
+{
     QDateTime startTime = QDateTime::currentDateTime();
     QDateTime endTime = startTime.addYears(10);
     QCA::CertificateInfo certificateInfo;
@@ -296,12 +423,7 @@ void TestSslSocketLineReader::setSocketAttributes(QSslSocket* socket, QString de
     certificateOptions.setValidityPeriod(startTime, endTime);
     certificateOptions.setFormat(QCA::PKCS10);
 
-    QCA::PrivateKey privKey = QCA::KeyGenerator().createRSA(2048);
-    QSslCertificate certificate = QSslCertificate(QCA::Certificate(certificateOptions, privKey).toPEM().toLatin1());
-
-    socket->setPrivateKey(QSslKey(privKey.toPEM().toLatin1(), QSsl::Rsa));
-    socket->setLocalCertificate(certificate);
-
+    return QSslCertificate(QCA::Certificate(certificateOptions, privKey).toPEM().toLatin1());
 }
 
 QTEST_GUILESS_MAIN(TestSslSocketLineReader)
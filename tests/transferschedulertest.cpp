@@ -0,0 +1,224 @@
+/**
+ * Copyright 2026 Albert Vaca Cintora <albertvaka@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../core/transferscheduler.h"
+
+#include <QBuffer>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+//Like the downloads of the links: it doesn't transfer anything until started
+class FakeDownload : public ScheduledPayload
+{
+    Q_OBJECT
+
+public:
+    FakeDownload() : m_started(false) { open(QIODevice::ReadOnly); }
+    void start() override { m_started = true; }
+    bool isStarted() const { return m_started; }
+    bool isSequential() const override { return true; }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override { Q_UNUSED(data); Q_UNUSED(maxSize); return -1; }
+    qint64 writeData(const char* data, qint64 maxSize) override { Q_UNUSED(data); Q_UNUSED(maxSize); return -1; }
+
+private:
+    bool m_started;
+};
+
+class TransferSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void limitsBulkTransfers();
+    void smallPayloadsFirst();
+    void droppedWhileQueued();
+    void uploadsWhenReady();
+    void uploadsNeverStarted();
+
+private:
+    static QList<QSharedPointer<FakeDownload>> enqueue(TransferScheduler& scheduler, int count, qint64 size);
+    static int startedCount(const QList<QSharedPointer<FakeDownload>>& downloads);
+
+    const static qint64 s_bulkSize = 100 * 1024 * 1024;
+    const static qint64 s_smallSize = 20 * 1024;
+};
+
+void TransferSchedulerTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+QList<QSharedPointer<FakeDownload>> TransferSchedulerTest::enqueue(TransferScheduler& scheduler, int count, qint64 size)
+{
+    QList<QSharedPointer<FakeDownload>> downloads;
+    for (int i = 0; i < count; ++i) {
+        QSharedPointer<FakeDownload> download(new FakeDownload());
+        scheduler.enqueueDownload(download, size);
+        downloads.append(download);
+    }
+    return downloads;
+}
+
+int TransferSchedulerTest::startedCount(const QList<QSharedPointer<FakeDownload>>& downloads)
+{
+    int ret = 0;
+    for (const QSharedPointer<FakeDownload>& download : downloads) {
+        ret += download->isStarted()? 1 : 0;
+    }
+    return ret;
+}
+
+void TransferSchedulerTest::limitsBulkTransfers()
+{
+    TransferScheduler scheduler;
+    QSignalSpy changed(&scheduler, &TransferScheduler::transfersChanged);
+    FakeDownload unscheduled;
+    QVERIFY(TransferScheduler::needsScheduling(&unscheduled));
+    QBuffer streamed;
+    QVERIFY(!TransferScheduler::needsScheduling(&streamed));
+    QVERIFY(!TransferScheduler::needsScheduling(nullptr));
+
+    const QList<QSharedPointer<FakeDownload>> downloads = enqueue(scheduler, 10, s_bulkSize);
+    QCOMPARE(startedCount(downloads), TransferScheduler::s_maxBulkTransfers);
+    QCOMPARE(scheduler.activeTransfers(), TransferScheduler::s_maxBulkTransfers);
+    QCOMPARE(scheduler.queuedTransfers(), 10 - TransferScheduler::s_maxBulkTransfers);
+    QCOMPARE(changed.count(), 10);
+
+    //They go in arrival order
+    downloads[0]->close();
+    QVERIFY(downloads[TransferScheduler::s_maxBulkTransfers]->isStarted());
+    QCOMPARE(startedCount(downloads), TransferScheduler::s_maxBulkTransfers + 1);
+    QCOMPARE(changed.last().at(0).toInt(), TransferScheduler::s_maxBulkTransfers);
+
+    //Closing twice, or finishing after being closed, doesn't free another slot
+    Q_EMIT downloads[0]->readChannelFinished();
+    downloads[0]->close();
+    QCOMPARE(startedCount(downloads), TransferScheduler::s_maxBulkTransfers + 1);
+
+    Q_EMIT downloads[1]->readChannelFinished();
+    QCOMPARE(startedCount(downloads), TransferScheduler::s_maxBulkTransfers + 2);
+}
+
+void TransferSchedulerTest::smallPayloadsFirst()
+{
+    TransferScheduler scheduler;
+    const QList<QSharedPointer<FakeDownload>> bulk = enqueue(scheduler, TransferScheduler::s_maxBulkTransfers + 2, s_bulkSize);
+
+    //Small payloads don't wait for the bulk ones to finish
+    const int smallCount = TransferScheduler::s_maxSmallTransfers + 2;
+    const QList<QSharedPointer<FakeDownload>> small = enqueue(scheduler, smallCount, s_smallSize);
+    QCOMPARE(startedCount(small), TransferScheduler::s_maxSmallTransfers);
+
+    //And the next free slot is for them, even if bulk ones were queued first
+    bulk[0]->close();
+    QCOMPARE(startedCount(small), TransferScheduler::s_maxSmallTransfers + 1);
+    QCOMPARE(startedCount(bulk), TransferScheduler::s_maxBulkTransfers);
+
+    small[0]->close();
+    QCOMPARE(startedCount(small), smallCount);
+    QCOMPARE(startedCount(bulk), TransferScheduler::s_maxBulkTransfers);
+
+    //Small slots are never used by bulk payloads
+    small[1]->close();
+    small[2]->close();
+    QCOMPARE(startedCount(bulk), TransferScheduler::s_maxBulkTransfers);
+    small[3]->close();
+    QCOMPARE(startedCount(bulk), TransferScheduler::s_maxBulkTransfers + 1);
+}
+
+void TransferSchedulerTest::droppedWhileQueued()
+{
+    TransferScheduler scheduler;
+    QList<QSharedPointer<FakeDownload>> downloads = enqueue(scheduler, TransferScheduler::s_maxBulkTransfers + 2, s_bulkSize);
+
+    //Nobody wanted it, the one after it goes next
+    downloads.removeAt(TransferScheduler::s_maxBulkTransfers);
+    QSharedPointer<FakeDownload> next = downloads.last();
+    downloads.takeFirst().reset();
+    QVERIFY(next->isStarted());
+    QCOMPARE(scheduler.activeTransfers(), TransferScheduler::s_maxBulkTransfers);
+    QCOMPARE(scheduler.queuedTransfers(), 0);
+}
+
+void TransferSchedulerTest::uploadsWhenReady()
+{
+    TransferScheduler scheduler;
+    QList<NetworkPacket> ready;
+    connect(&scheduler, &TransferScheduler::uploadReady, this, [&ready](const NetworkPacket& np) {
+        ready.append(np);
+    });
+
+    QList<QSharedPointer<QBuffer>> payloads;
+    for (int i = 0; i < TransferScheduler::s_maxBulkTransfers + 1; ++i) {
+        QSharedPointer<QBuffer> payload(new QBuffer());
+        NetworkPacket np(QStringLiteral("kdeconnect.share.request"));
+        np.setPayload(payload, s_bulkSize);
+        scheduler.enqueueUpload(np);
+        payloads.append(payload);
+    }
+    QCOMPARE(ready.count(), TransferScheduler::s_maxBulkTransfers);
+    QCOMPARE(scheduler.queuedTransfers(), 1);
+
+    //The link opens the payload when the peer asks for it, and closes it when it's sent
+    payloads[0]->open(QIODevice::ReadOnly);
+    payloads[0]->close();
+    QCOMPARE(ready.count(), TransferScheduler::s_maxBulkTransfers + 1);
+    QVERIFY(ready.last().payload() == payloads.last());
+
+    //A packet that couldn't be sent gives its slot back
+    scheduler.release(payloads[1].data());
+    QCOMPARE(scheduler.activeTransfers(), TransferScheduler::s_maxBulkTransfers - 1);
+}
+
+void TransferSchedulerTest::uploadsNeverStarted()
+{
+    TransferScheduler scheduler;
+    scheduler.setStartTimeout(100);
+
+    //Icons come in a buffer that is open already, that doesn't mean the peer asked for them
+    QList<QSharedPointer<QBuffer>> payloads;
+    for (int i = 0; i < 2; ++i) {
+        QSharedPointer<QBuffer> payload(new QBuffer());
+        payload->setData(QByteArray(s_smallSize, 'x'));
+        payload->open(QIODevice::ReadOnly);
+        NetworkPacket np(QStringLiteral("kdeconnect.notification"));
+        np.setPayload(payload, s_smallSize);
+        scheduler.enqueueUpload(np);
+        payloads.append(payload);
+    }
+    QCOMPARE(scheduler.activeTransfers(), 2);
+
+    scheduler.uploadStarted(payloads[0].data());
+    QTRY_COMPARE(scheduler.activeTransfers(), 1);
+    QTest::qWait(200);
+    QCOMPARE(scheduler.activeTransfers(), 1);
+
+    payloads[0]->close();
+    QCOMPARE(scheduler.activeTransfers(), 0);
+}
+
+QTEST_GUILESS_MAIN(TransferSchedulerTest)
+
+#include "transferschedulertest.moc"